@@ -0,0 +1,250 @@
+////////////////////////////////////////////////////////////////////////
+//
+// Thread placement policies for the stress tests.
+//
+// affinity_init() reads the topology of the CPUs this process may run
+// on from sysfs, and affinity_pin() then binds the calling thread to
+// the CPU chosen by the policy for the thread's group and index within
+// that group.  Tests with two kinds of threads (such as pushers and
+// poppers) use group 0 for the first kind and group 1 for the second.
+// The policies are:
+//
+//	none:		Leave placement to the scheduler.
+//	compact:	Fill SMT siblings, then cores, then sockets.
+//	scatter:	Spread over sockets, then cores, then SMT siblings.
+//	cross-socket:	Put group 0 on one socket and group 1 on another.
+//	smt-pair:	Put thread i of group 0 and thread i of group 1 on
+//			SMT siblings of the same core, or adjacent cores
+//			if there is no SMT.
+//
+// There is no libnuma dependency: memory placement relies on the first
+// touch by a pinned thread, so threads should initialize their own data
+// after calling affinity_pin().
+//
+// This uses the raw sched_{get,set}affinity() system calls to avoid
+// needing _GNU_SOURCE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define AFFINITY_MAX_CPUS 4096
+#define AFFINITY_MASK_LONGS (AFFINITY_MAX_CPUS / (8 * sizeof(unsigned long)))
+
+#define AFFINITY_NONE		0
+#define AFFINITY_COMPACT	1
+#define AFFINITY_SCATTER	2
+#define AFFINITY_CROSS_SOCKET	3
+#define AFFINITY_SMT_PAIR	4
+
+const char *affinity_names[] = {
+	"none", "compact", "scatter", "cross-socket", "smt-pair",
+};
+
+struct affinity_cpu {
+	int cpu;
+	int pkg;
+	int core;
+	int corerank; // Rank of this core within its package.
+	int sib;      // Rank of this CPU among its core's SMT siblings.
+};
+
+struct affinity_cpu affinity_cpus[AFFINITY_MAX_CPUS];
+int affinity_ncpus;
+int affinity_ncores;
+int affinity_npkgs;
+int affinity_policy;
+int affinity_ngroup0; // Number of threads in group 0.
+
+// Parse a policy name, returning -1 if invalid.
+int affinity_parse(const char *name)
+{
+	int i;
+
+	for (i = 0; i < (int)(sizeof(affinity_names) / sizeof(affinity_names[0])); i++)
+		if (!strcmp(name, affinity_names[i]))
+			return i;
+	return -1;
+}
+
+int affinity_read_topology(int cpu, const char *what, int dflt)
+{
+	char path[128];
+	FILE *fp;
+	int ret;
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, what);
+	fp = fopen(path, "r");
+	if (!fp)
+		return dflt;
+	if (fscanf(fp, "%d", &ret) != 1)
+		ret = dflt;
+	fclose(fp);
+	return ret;
+}
+
+int affinity_cmp_compact(const void *a, const void *b)
+{
+	const struct affinity_cpu *x = a;
+	const struct affinity_cpu *y = b;
+
+	if (x->pkg != y->pkg)
+		return x->pkg - y->pkg;
+	if (x->core != y->core)
+		return x->core - y->core;
+	return x->cpu - y->cpu;
+}
+
+int affinity_cmp_scatter(const void *a, const void *b)
+{
+	const struct affinity_cpu *x = a;
+	const struct affinity_cpu *y = b;
+
+	if (x->sib != y->sib)
+		return x->sib - y->sib;
+	if (x->corerank != y->corerank)
+		return x->corerank - y->corerank;
+	return x->pkg - y->pkg;
+}
+
+void affinity_init(int policy, int ngroup0)
+{
+	unsigned long mask[AFFINITY_MASK_LONGS];
+	struct affinity_cpu *ap;
+	int bits = 8 * sizeof(unsigned long);
+	int cpu;
+	int i;
+
+	affinity_policy = policy;
+	affinity_ngroup0 = ngroup0;
+	affinity_ncpus = 0;
+	memset(mask, 0, sizeof(mask));
+	if (syscall(SYS_sched_getaffinity, 0, sizeof(mask), mask) < 0) {
+		perror("sched_getaffinity");
+		exit(1);
+	}
+	for (cpu = 0; cpu < AFFINITY_MAX_CPUS; cpu++) {
+		if (!(mask[cpu / bits] & (1UL << (cpu % bits))))
+			continue;
+		ap = &affinity_cpus[affinity_ncpus++];
+		ap->cpu = cpu;
+		ap->pkg = affinity_read_topology(cpu, "physical_package_id", 0);
+		ap->core = affinity_read_topology(cpu, "core_id", cpu);
+	}
+
+	// Compute sibling and core ranks from the compact ordering.
+	qsort(affinity_cpus, affinity_ncpus, sizeof(affinity_cpus[0]),
+	      affinity_cmp_compact);
+	affinity_ncores = 0;
+	affinity_npkgs = 0;
+	for (i = 0; i < affinity_ncpus; i++) {
+		ap = &affinity_cpus[i];
+		if (i && ap->pkg == ap[-1].pkg && ap->core == ap[-1].core) {
+			ap->sib = ap[-1].sib + 1;
+			ap->corerank = ap[-1].corerank;
+			continue;
+		}
+		ap->sib = 0;
+		affinity_ncores++;
+		if (i && ap->pkg == ap[-1].pkg) {
+			ap->corerank = ap[-1].corerank + 1;
+		} else {
+			ap->corerank = 0;
+			affinity_npkgs++;
+		}
+	}
+	if (policy == AFFINITY_SCATTER)
+		qsort(affinity_cpus, affinity_ncpus, sizeof(affinity_cpus[0]),
+		      affinity_cmp_scatter);
+}
+
+// Return the index in affinity_cpus[] of the nth CPU of the specified
+// package, in compact order.
+int affinity_pkg_cpu(int pkgidx, int n)
+{
+	int first = -1;
+	int i;
+	int len = 0;
+	int p = -1;
+
+	for (i = 0; i < affinity_ncpus; i++) {
+		if (!i || affinity_cpus[i].pkg != affinity_cpus[i - 1].pkg)
+			p++;
+		if (p == pkgidx) {
+			if (first < 0)
+				first = i;
+			len++;
+		}
+	}
+	return first + n % len;
+}
+
+// Return the index in affinity_cpus[] of the first CPU of the nth core.
+int affinity_core_cpu(int n)
+{
+	int c = -1;
+	int i;
+
+	n %= affinity_ncores;
+	for (i = 0; i < affinity_ncpus; i++) {
+		if (!affinity_cpus[i].sib)
+			c++;
+		if (c == n)
+			return i;
+	}
+	return 0;
+}
+
+// Return the CPU for thread idx of the specified group, or -1 for none.
+int affinity_pick(int group, int idx)
+{
+	int i;
+
+	switch (affinity_policy) {
+	case AFFINITY_COMPACT:
+	case AFFINITY_SCATTER:
+		i = group ? affinity_ngroup0 + idx : idx;
+		return affinity_cpus[i % affinity_ncpus].cpu;
+	case AFFINITY_CROSS_SOCKET:
+		i = affinity_pkg_cpu(group % affinity_npkgs, idx);
+		return affinity_cpus[i].cpu;
+	case AFFINITY_SMT_PAIR:
+		if (affinity_ncpus > affinity_ncores) {
+			i = affinity_core_cpu(idx);
+			if (i + 1 < affinity_ncpus && affinity_cpus[i + 1].sib)
+				i += group;
+		} else {
+			i = affinity_core_cpu(2 * idx + group);
+		}
+		return affinity_cpus[i].cpu;
+	}
+	return -1;
+}
+
+// Bind the calling thread per the policy, returning the CPU or -1.
+int affinity_pin(int group, int idx)
+{
+	unsigned long mask[AFFINITY_MASK_LONGS];
+	int bits = 8 * sizeof(unsigned long);
+	int cpu = affinity_pick(group, idx);
+
+	if (cpu < 0)
+		return -1;
+	memset(mask, 0, sizeof(mask));
+	mask[cpu / bits] |= 1UL << (cpu % bits);
+	if (syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask) < 0) {
+		perror("sched_setaffinity");
+		exit(1);
+	}
+	return cpu;
+}
+
+void affinity_print(const char *name)
+{
+	printf("%s affinity: policy %s, %d CPUs, %d cores, %d packages\n",
+	       name, affinity_names[affinity_policy],
+	       affinity_ncpus, affinity_ncores, affinity_npkgs);
+}
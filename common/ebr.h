@@ -0,0 +1,206 @@
+////////////////////////////////////////////////////////////////////////
+//
+// Epoch-based reclamation (EBR), a lightweight self-contained alternative
+// to liburcu for the tests in this repository.
+//
+// Readers bracket their accesses with ebr_read_lock() and ebr_read_unlock(),
+// which may nest.  Updaters unlink an object and then pass it to
+// ebr_retire(), which defers invoking the specified function on it until
+// no reader can still hold a reference.  Each thread keeps its retired
+// objects in three limbo lists indexed by the global epoch at retire time.
+// Every EBR_BATCH retirements, the thread attempts to advance the global
+// epoch, which succeeds only if every reader currently in a critical
+// section has observed the current epoch, and then frees the limbo lists
+// that are two or more epochs old.
+//
+// Threads are registered lazily on first use, but should call
+// ebr_unregister_thread() before exiting so that their pending objects
+// are freed.  Neither ebr_synchronize() nor ebr_unregister_thread() may
+// be invoked from within a read-side critical section.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#ifndef EBR_MAX_THREADS
+#define EBR_MAX_THREADS 256
+#endif
+#ifndef EBR_BATCH
+#define EBR_BATCH 1024
+#endif
+
+struct ebr_cb {
+	void *p;
+	void (*func)(void *p);
+};
+
+struct ebr_limbo {
+	unsigned long epoch;
+	long n;
+	long max;
+	struct ebr_cb *cbs;
+};
+
+struct ebr_thread {
+	unsigned long _Atomic state; // (epoch << 1) | 1 if reading, else 0.
+	int _Atomic inuse;
+	int nesting;
+	long nretired; // Since last attempt to advance the epoch.
+	struct ebr_limbo limbo[3];
+} __attribute__((__aligned__(64)));
+
+unsigned long _Atomic ebr_epoch;
+struct ebr_thread ebr_thread[EBR_MAX_THREADS];
+int _Atomic ebr_nslots; // High-water mark of slots ever used.
+__thread struct ebr_thread *ebr_me;
+
+void ebr_register_thread(void)
+{
+	int i;
+	int n;
+
+	if (ebr_me)
+		return;
+	for (i = 0; i < EBR_MAX_THREADS; i++) {
+		int expected = 0;
+
+		if (atomic_compare_exchange_strong(&ebr_thread[i].inuse, &expected, 1))
+			break;
+	}
+	if (i >= EBR_MAX_THREADS) {
+		fprintf(stderr, "Out of EBR thread slots\n");
+		abort();
+	}
+	ebr_me = &ebr_thread[i];
+	n = atomic_load(&ebr_nslots);
+	while (n <= i && !atomic_compare_exchange_weak(&ebr_nslots, &n, i + 1))
+		continue;
+}
+
+void ebr_read_lock(void)
+{
+	struct ebr_thread *me = ebr_me;
+
+	if (!me) {
+		ebr_register_thread();
+		me = ebr_me;
+	}
+	if (me->nesting++)
+		return;
+	atomic_store_explicit(&me->state, (atomic_load(&ebr_epoch) << 1) | 1,
+			      memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+}
+
+void ebr_read_unlock(void)
+{
+	struct ebr_thread *me = ebr_me;
+
+	if (--me->nesting)
+		return;
+	atomic_store_explicit(&me->state, 0, memory_order_release);
+}
+
+// Advance the global epoch if all current readers have observed it.
+// Returns true if the epoch was advanced, by this thread or another.
+int ebr_try_advance(void)
+{
+	unsigned long e = atomic_load(&ebr_epoch);
+	int i;
+	int n = atomic_load(&ebr_nslots);
+
+	atomic_thread_fence(memory_order_seq_cst);
+	for (i = 0; i < n; i++) {
+		unsigned long s = atomic_load(&ebr_thread[i].state);
+
+		if ((s & 1) && (s >> 1) != e)
+			return 0;
+	}
+	atomic_compare_exchange_strong(&ebr_epoch, &e, e + 1);
+	return 1;
+}
+
+void ebr_free_limbo(struct ebr_limbo *lp)
+{
+	long i;
+
+	for (i = 0; i < lp->n; i++)
+		lp->cbs[i].func(lp->cbs[i].p);
+	lp->n = 0;
+}
+
+// Free this thread's limbo lists that are at least two epochs old.
+void ebr_reclaim(void)
+{
+	unsigned long e = atomic_load(&ebr_epoch);
+	int i;
+
+	for (i = 0; i < 3; i++)
+		if (ebr_me->limbo[i].n && ebr_me->limbo[i].epoch + 2 <= e)
+			ebr_free_limbo(&ebr_me->limbo[i]);
+}
+
+void ebr_retire(void *p, void (*func)(void *p))
+{
+	unsigned long e;
+	struct ebr_limbo *lp;
+
+	if (!ebr_me)
+		ebr_register_thread();
+	e = atomic_load(&ebr_epoch);
+	lp = &ebr_me->limbo[e % 3];
+	if (lp->epoch != e) {
+		// Anything still here was retired at least three epochs ago.
+		ebr_free_limbo(lp);
+		lp->epoch = e;
+	}
+	if (lp->n >= lp->max) {
+		lp->max = lp->max ? lp->max * 2 : EBR_BATCH;
+		lp->cbs = realloc(lp->cbs, lp->max * sizeof(lp->cbs[0]));
+		if (!lp->cbs) {
+			perror("realloc");
+			abort();
+		}
+	}
+	lp->cbs[lp->n].p = p;
+	lp->cbs[lp->n].func = func;
+	lp->n++;
+	if (++ebr_me->nretired >= EBR_BATCH) {
+		ebr_me->nretired = 0;
+		ebr_try_advance();
+		ebr_reclaim();
+	}
+}
+
+// Wait until all objects previously retired by this thread may be freed,
+// and free them.
+void ebr_synchronize(void)
+{
+	unsigned long e = atomic_load(&ebr_epoch);
+
+	if (!ebr_me)
+		return;
+	while (atomic_load(&ebr_epoch) < e + 2)
+		if (!ebr_try_advance())
+			sched_yield();
+	ebr_reclaim();
+}
+
+void ebr_unregister_thread(void)
+{
+	int i;
+
+	if (!ebr_me)
+		return;
+	ebr_synchronize();
+	for (i = 0; i < 3; i++) {
+		free(ebr_me->limbo[i].cbs);
+		ebr_me->limbo[i].cbs = NULL;
+		ebr_me->limbo[i].max = 0;
+	}
+	ebr_me->nretired = 0;
+	atomic_store(&ebr_me->state, 0);
+	atomic_store(&ebr_me->inuse, 0);
+	ebr_me = NULL;
+}
@@ -0,0 +1,71 @@
+////////////////////////////////////////////////////////////////////////
+//
+// Futex-based eventcount, for parking threads that have run out of work.
+//
+// A waiter calls ec_prepare(), re-checks its wait condition, and then
+// calls ec_wait() if there is still nothing to do or ec_cancel() if
+// there is.  A notifier first makes the condition true and then checks
+// ec_has_waiters(), calling ec_notify() only if it returns true.  The
+// full barriers in ec_prepare() and ec_has_waiters() ensure that either
+// the waiter sees the condition or the notifier sees the waiter, so
+// wakeups cannot be lost, while notifiers never enter the kernel when
+// no thread is parked.
+//
+// Unlike the other headers here, this one may be included both by a
+// lifo-push variant and by lifo-stress.h, hence the include guard.
+
+#ifndef EVENTCOUNT_H
+#define EVENTCOUNT_H
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+struct eventcount {
+	unsigned int _Atomic seq; // Futex word, bumped by each notification.
+	int _Atomic nwaiters;
+};
+
+// Announce intent to wait, returning the key to pass to ec_wait().
+unsigned int ec_prepare(struct eventcount *ecp)
+{
+	atomic_fetch_add(&ecp->nwaiters, 1);
+	atomic_thread_fence(memory_order_seq_cst);
+	return atomic_load(&ecp->seq);
+}
+
+void ec_cancel(struct eventcount *ecp)
+{
+	atomic_fetch_sub(&ecp->nwaiters, 1);
+}
+
+// Sleep unless there has been a notification since ec_prepare() returned
+// key.  Returns 1 if this thread actually slept and was woken, although
+// as always with futexes, the wakeup might be spurious.
+int ec_wait(struct eventcount *ecp, unsigned int key)
+{
+	int ret = 0;
+
+	if (atomic_load(&ecp->seq) == key)
+		ret = syscall(SYS_futex, &ecp->seq, FUTEX_WAIT_PRIVATE, key,
+			      NULL, NULL, 0) == 0;
+	atomic_fetch_sub(&ecp->nwaiters, 1);
+	return ret;
+}
+
+int ec_has_waiters(struct eventcount *ecp)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	return atomic_load_explicit(&ecp->nwaiters, memory_order_relaxed) != 0;
+}
+
+// Wake up to n waiters, or all of them if n is INT_MAX.
+void ec_notify(struct eventcount *ecp, int n)
+{
+	atomic_fetch_add(&ecp->seq, 1);
+	syscall(SYS_futex, &ecp->seq, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+#endif /* #ifndef EVENTCOUNT_H */
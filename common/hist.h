@@ -0,0 +1,109 @@
+////////////////////////////////////////////////////////////////////////
+//
+// Low-overhead log-linear latency histograms, in the style of HdrHistogram.
+//
+// Values below 2^HIST_SUB_BITS are recorded exactly.  Larger values are
+// recorded in one of 2^HIST_SUB_BITS linear sub-buckets within their
+// power of two, for a worst-case relative error of about 2^-HIST_SUB_BITS.
+// Recording a value is a count-leading-zeroes and an increment, so each
+// thread should record into its own histogram and then merge it into a
+// shared one when done.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifndef HIST_SUB_BITS
+#define HIST_SUB_BITS 4
+#endif
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_NBUCKETS ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+struct hist {
+	unsigned long count[HIST_NBUCKETS];
+	unsigned long n;
+	unsigned long max;
+	pthread_mutex_t lock; // Protects merges into this histogram.
+};
+
+unsigned long nsec_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+void hist_init(struct hist *h)
+{
+	memset(h->count, 0, sizeof(h->count));
+	h->n = 0;
+	h->max = 0;
+	pthread_mutex_init(&h->lock, NULL);
+}
+
+int hist_index(unsigned long v)
+{
+	int shift;
+
+	if (v < HIST_SUB_COUNT)
+		return v;
+	shift = 63 - __builtin_clzl(v) - HIST_SUB_BITS;
+	return ((shift + 1) << HIST_SUB_BITS) + ((v >> shift) & (HIST_SUB_COUNT - 1));
+}
+
+// Largest value that maps to the specified bucket.
+unsigned long hist_value(int i)
+{
+	int shift = (i >> HIST_SUB_BITS) - 1;
+
+	if (shift < 0)
+		return i;
+	return ((((unsigned long)HIST_SUB_COUNT + (i & (HIST_SUB_COUNT - 1)) + 1) << shift) - 1);
+}
+
+void hist_record(struct hist *h, unsigned long v)
+{
+	h->count[hist_index(v)]++;
+	h->n++;
+	if (v > h->max)
+		h->max = v;
+}
+
+void hist_merge(struct hist *dst, struct hist *src)
+{
+	int i;
+
+	pthread_mutex_lock(&dst->lock);
+	for (i = 0; i < HIST_NBUCKETS; i++)
+		dst->count[i] += src->count[i];
+	dst->n += src->n;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	pthread_mutex_unlock(&dst->lock);
+}
+
+// Return the value below which pct percent of the recorded values fall.
+unsigned long hist_percentile(struct hist *h, double pct)
+{
+	unsigned long target = (unsigned long)(h->n * pct / 100.);
+	unsigned long sum = 0;
+	int i;
+
+	if (target >= h->n)
+		return h->max;
+	for (i = 0; i < HIST_NBUCKETS; i++) {
+		sum += h->count[i];
+		if (sum > target)
+			return hist_value(i) < h->max ? hist_value(i) : h->max;
+	}
+	return h->max;
+}
+
+void hist_print(struct hist *h, const char *name, const char *what)
+{
+	printf("%s %s latency (ns): n %lu p50 %lu p99 %lu p99.9 %lu max %lu\n",
+	       name, what, h->n, hist_percentile(h, 50.), hist_percentile(h, 99.),
+	       hist_percentile(h, 99.9), h->max);
+}
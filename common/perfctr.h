@@ -0,0 +1,136 @@
+////////////////////////////////////////////////////////////////////////
+//
+// Per-thread hardware performance counters via perf_event_open().
+//
+// Each thread calls perfctr_start() at the beginning of its measured
+// region and perfctr_stop() at the end, which adds its counts into a
+// shared struct perfctr_totals.  Counters that cannot be opened, for
+// example due to perf_event_paranoid settings or a container lacking
+// access to the PMU, are simply omitted from the report.  Counts are
+// scaled to compensate for counter multiplexing.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define PERFCTR_CYCLES		0
+#define PERFCTR_INSTRUCTIONS	1
+#define PERFCTR_LLC_MISSES	2
+#define PERFCTR_L1D_MISSES	3
+#define PERFCTR_N		4
+
+struct perfctr_desc {
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+} perfctr_desc[PERFCTR_N] = {
+	{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ "LLC-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	// L1D read misses, which include cache-line transfers from other CPUs.
+	{ "L1D-misses", PERF_TYPE_HW_CACHE,
+	  PERF_COUNT_HW_CACHE_L1D |
+	  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+	  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+};
+
+struct perfctr {
+	int fd[PERFCTR_N];
+};
+
+struct perfctr_totals {
+	double val[PERFCTR_N];
+	int nthreads[PERFCTR_N]; // Number of threads contributing.
+	int nstarted;
+	pthread_mutex_t lock;
+};
+
+void perfctr_init(struct perfctr_totals *ptp)
+{
+	memset(ptp, 0, sizeof(*ptp));
+	pthread_mutex_init(&ptp->lock, NULL);
+}
+
+void perfctr_start(struct perfctr *pcp)
+{
+	struct perf_event_attr attr;
+	int i;
+
+	for (i = 0; i < PERFCTR_N; i++) {
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = perfctr_desc[i].type;
+		attr.config = perfctr_desc[i].config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+				   PERF_FORMAT_TOTAL_TIME_RUNNING;
+		pcp->fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+	for (i = 0; i < PERFCTR_N; i++)
+		if (pcp->fd[i] >= 0)
+			ioctl(pcp->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+}
+
+void perfctr_stop(struct perfctr *pcp, struct perfctr_totals *ptp)
+{
+	uint64_t buf[3]; // Value, time enabled, time running.
+	double val[PERFCTR_N];
+	int ok[PERFCTR_N];
+	int i;
+
+	for (i = 0; i < PERFCTR_N; i++)
+		if (pcp->fd[i] >= 0)
+			ioctl(pcp->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+	for (i = 0; i < PERFCTR_N; i++) {
+		ok[i] = 0;
+		if (pcp->fd[i] < 0)
+			continue;
+		if (read(pcp->fd[i], buf, sizeof(buf)) == sizeof(buf) && buf[2]) {
+			val[i] = (double)buf[0] * buf[1] / buf[2];
+			ok[i] = 1;
+		}
+		close(pcp->fd[i]);
+	}
+	pthread_mutex_lock(&ptp->lock);
+	ptp->nstarted++;
+	for (i = 0; i < PERFCTR_N; i++) {
+		if (!ok[i])
+			continue;
+		ptp->val[i] += val[i];
+		ptp->nthreads[i]++;
+	}
+	pthread_mutex_unlock(&ptp->lock);
+}
+
+// Print derived metrics for the specified number of operations, omitting
+// counters that were not available for all threads.
+void perfctr_print(struct perfctr_totals *ptp, const char *name,
+		   const char *what, double nops)
+{
+	int have[PERFCTR_N];
+	int i;
+	int n = 0;
+
+	for (i = 0; i < PERFCTR_N; i++) {
+		have[i] = ptp->nstarted && ptp->nthreads[i] == ptp->nstarted;
+		n += have[i];
+	}
+	if (!n) {
+		printf("%s %s perf counters: unavailable\n", name, what);
+		return;
+	}
+	printf("%s %s perf counters:", name, what);
+	if (have[PERFCTR_CYCLES] && have[PERFCTR_INSTRUCTIONS])
+		printf(" IPC %.3f", ptp->val[PERFCTR_INSTRUCTIONS] / ptp->val[PERFCTR_CYCLES]);
+	for (i = 0; i < PERFCTR_N; i++)
+		if (have[i] && nops > 0)
+			printf(" %s/op %.3f", perfctr_desc[i].name, ptp->val[i] / nops);
+	printf("\n");
+}
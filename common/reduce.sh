@@ -0,0 +1,133 @@
+#!/bin/sh
+#
+# Reduce the "result," CSV records emitted by the tests run with "-o csv"
+# (for example, by lifo-push-test.sh) into per-configuration statistics.
+#
+# Usage: reduce.sh [ -b baseline ] [ -c previous.csv [ -t percent ] ] < output
+#
+# Records are grouped by variant and parameters.  For each group, the
+# output gives the number of runs, the median ops/sec along with a
+# nonparametric 95% confidence interval for that median, the median wall,
+# user and system times, and the speedup relative to the baseline variant
+# (lifo-push by default) having the same parameters.  Output is CSV sorted
+# by parameters and then by variant.
+#
+# If -c is given, the output of a previous run of this script is compared
+# against, and any group whose median ops/sec dropped by more than
+# -t percent (default 5) with non-overlapping confidence intervals is
+# reported on stderr, and the exit status is 1.
+
+baseline=lifo-push
+previous=/dev/null
+threshold=5
+while getopts b:c:t: opt
+do
+	case $opt in
+	b)	baseline="$OPTARG" ;;
+	c)	previous="$OPTARG" ;;
+	t)	threshold="$OPTARG" ;;
+	*)	echo "Usage: $0 [ -b baseline ] [ -c previous.csv [ -t percent ] ]" 1>&2
+		exit 2 ;;
+	esac
+done
+shift `expr $OPTIND - 1`
+
+awk -F, -v baseline="$baseline" -v threshold="$threshold" '
+# Sort a[1..n] in place.
+function isort(a, n,    i, j, t) {
+	for (i = 2; i <= n; i++) {
+		t = a[i];
+		for (j = i - 1; j >= 1 && a[j] > t; j--)
+			a[j + 1] = a[j];
+		a[j + 1] = t;
+	}
+}
+
+function median(a, n) {
+	isort(a, n);
+	if (n % 2)
+		return a[(n + 1) / 2];
+	return (a[n / 2] + a[n / 2 + 1]) / 2;
+}
+
+# Load one field of group g into tmp[], returning the count.
+function load(g, f,    i) {
+	for (i = 1; i <= count[g]; i++)
+		tmp[i] = val[g, i, f] + 0;
+	return count[g];
+}
+
+# Previous summary from -c, skipping its header.
+FILENAME != "-" && FNR > 1 {
+	prev_med[$1 "," $2] = $4;
+	prev_lo[$1 "," $2] = $5;
+	next;
+}
+
+FILENAME != "-" {
+	next;
+}
+
+$1 == "result" {
+	g = $2 "," $3;
+	if (!(g in count)) {
+		ngroups++;
+		group[ngroups] = g;
+		gparams[g] = $3;
+		gvariant[g] = $2;
+	}
+	n = ++count[g];
+	val[g, n, "wall"] = $6;
+	val[g, n, "user"] = $7;
+	val[g, n, "sys"] = $8;
+	val[g, n, "rate"] = $9;
+}
+
+END {
+	# Sort groups by parameters, then by variant, for deterministic output.
+	for (i = 2; i <= ngroups; i++) {
+		t = group[i];
+		tk = gparams[t] "," gvariant[t];
+		for (j = i - 1; j >= 1 && gparams[group[j]] "," gvariant[group[j]] > tk; j--)
+			group[j + 1] = group[j];
+		group[j + 1] = t;
+	}
+	for (i = 1; i <= ngroups; i++) {
+		g = group[i];
+		n = load(g, "rate");
+		med[g] = median(tmp, n);
+		# Ranks bounding a 95% confidence interval for the median.
+		lo = int(n / 2 - 1.96 * sqrt(n) / 2);
+		hi = int(1 + n / 2 + 1.96 * sqrt(n) / 2 + 0.999999);
+		if (lo < 1)
+			lo = 1;
+		if (hi > n)
+			hi = n;
+		cilo[g] = tmp[lo];
+		cihi[g] = tmp[hi];
+		n = load(g, "wall");
+		wall[g] = median(tmp, n);
+		n = load(g, "user");
+		user[g] = median(tmp, n);
+		n = load(g, "sys");
+		sys[g] = median(tmp, n);
+	}
+	print "variant,params,n,median_ops_per_sec,ci95_lo,ci95_hi,median_wall,median_user,median_sys,speedup";
+	ret = 0;
+	for (i = 1; i <= ngroups; i++) {
+		g = group[i];
+		b = baseline "," gparams[g];
+		speedup = (b in med) && med[b] > 0 ? sprintf("%.3f", med[g] / med[b]) : "";
+		printf "%s,%s,%d,%.1f,%.1f,%.1f,%.6f,%.6f,%.6f,%s\n",
+		       gvariant[g], gparams[g], count[g], med[g], cilo[g], cihi[g],
+		       wall[g], user[g], sys[g], speedup;
+		if ((g in prev_med) &&
+		    med[g] < prev_med[g] * (1 - threshold / 100) &&
+		    cihi[g] < prev_lo[g]) {
+			printf "REGRESSION: %s %s: %.1f ops/sec, was %.1f\n",
+			       gvariant[g], gparams[g], med[g], prev_med[g] > "/dev/stderr";
+			ret = 1;
+		}
+	}
+	exit ret;
+}' "$previous" -
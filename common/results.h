@@ -0,0 +1,86 @@
+////////////////////////////////////////////////////////////////////////
+//
+// Machine-readable benchmark results.
+//
+// Each test brackets its measured region with results_start() and
+// results_stop(), then calls results_print() to emit a single record
+// in either CSV or JSON form.  CSV records have the following fields:
+//
+//	result,variant,params,threads,ops,wall,user,sys,ops_per_sec
+//
+// where "params" is a semicolon-separated list of name=value test
+// parameters and times are in seconds.  See common/reduce.sh, which
+// aggregates such records.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#define RESULTS_NONE 0
+#define RESULTS_CSV  1
+#define RESULTS_JSON 2
+
+struct results {
+	struct timespec ts;
+	struct rusage ru;
+	double wall;
+	double user;
+	double sys;
+};
+
+// Parse a -o argument, returning -1 if invalid.
+int results_format(const char *arg)
+{
+	if (!strcmp(arg, "csv"))
+		return RESULTS_CSV;
+	if (!strcmp(arg, "json"))
+		return RESULTS_JSON;
+	return -1;
+}
+
+void results_start(struct results *rp)
+{
+	clock_gettime(CLOCK_MONOTONIC, &rp->ts);
+	getrusage(RUSAGE_SELF, &rp->ru);
+}
+
+double results_tv(struct timeval *tv)
+{
+	return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+void results_stop(struct results *rp)
+{
+	struct timespec ts;
+	struct rusage ru;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	getrusage(RUSAGE_SELF, &ru);
+	rp->wall = (ts.tv_sec - rp->ts.tv_sec) + (ts.tv_nsec - rp->ts.tv_nsec) / 1e9;
+	rp->user = results_tv(&ru.ru_utime) - results_tv(&rp->ru.ru_utime);
+	rp->sys = results_tv(&ru.ru_stime) - results_tv(&rp->ru.ru_stime);
+}
+
+// Print a result record for the specified variant, omitting any leading
+// directory from its name.
+void results_print(int format, const char *variant, const char *params,
+		   long threads, double ops, struct results *rp)
+{
+	const char *cp = strrchr(variant, '/');
+	double rate = rp->wall > 0 ? ops / rp->wall : 0;
+
+	if (cp)
+		variant = cp + 1;
+	if (format == RESULTS_CSV)
+		printf("result,%s,%s,%ld,%.0f,%.6f,%.6f,%.6f,%.1f\n",
+		       variant, params, threads, ops,
+		       rp->wall, rp->user, rp->sys, rate);
+	else if (format == RESULTS_JSON)
+		printf("{\"variant\": \"%s\", \"params\": \"%s\", \"threads\": %ld, "
+		       "\"ops\": %.0f, \"wall\": %.6f, \"user\": %.6f, "
+		       "\"sys\": %.6f, \"ops_per_sec\": %.1f}\n",
+		       variant, params, threads, ops,
+		       rp->wall, rp->user, rp->sys, rate);
+}
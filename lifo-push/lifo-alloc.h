@@ -0,0 +1,162 @@
+////////////////////////////////////////////////////////////////////////
+//
+// Node allocation for the lifo-push variants.
+//
+// By default, node_alloc() and node_free() are simply malloc() and
+// free().  Building with -DNODE_POOL instead uses per-thread node pools
+// so that the stress test measures the LIFO algorithm rather than the
+// contention in the underlying memory allocator.
+//
+// Nodes are freed by the poppers but allocated by the pushers, so each
+// thread accumulates the nodes that it frees into a local batch.  Full
+// batches are handed back to a global depot, and threads whose local
+// allocation list runs dry take a full batch from the depot, carving a
+// new slab from malloc() only when the depot is empty.  The depot lock
+// is therefore acquired only once per NODE_POOL_BATCH nodes.
+//
+// Memory is never returned to malloc(), so pooled nodes are type-stable.
+//
+// Callers that push their own nodes rather than using node_alloc() set
+// node_caller_owned, which makes node_free() do nothing.
+//
+// Each node is followed by node_payload bytes of payload, which must be
+// set before the first node_alloc().  The allocating thread fills in the
+// payload, so that consumers processing it must pull it from the
+// producer's cache, as they would with real data.
+//
+// Include this after the definition of struct node_t.
+
+#include <string.h>
+#include <stdint.h>
+
+long node_payload; // Bytes of payload following each node.
+int node_caller_owned; // Nodes are not from node_alloc(), so never free.
+
+#define node_payload_ptr(p) ((char *)((p) + 1))
+
+// Bytes per node including payload, keeping nodes 16-byte aligned.
+long node_size(void)
+{
+	return (sizeof(struct node_t) + node_payload + 15) & ~15L;
+}
+
+struct node_t *node_payload_fill(struct node_t *p)
+{
+	if (node_payload)
+		memset(node_payload_ptr(p), (uintptr_t)p >> 4, node_payload);
+	return p;
+}
+
+#ifdef NODE_POOL
+
+#ifndef NODE_POOL_BATCH
+#define NODE_POOL_BATCH 256
+#endif
+
+// Overlays a free node.  Some variants load a node's ->next pointer
+// after the node might have been freed, relying on the pool to keep it
+// type-stable.  nextbatch may overlay that pointer, so it is atomic and
+// accessed only with relaxed atomics, so that it cannot race with such
+// a load.  The next field overlays the value, which no such load reads.
+struct node_pool_obj {
+	struct node_pool_obj *next;		 // Next free node in this batch.
+	struct node_pool_obj *_Atomic nextbatch; // Next batch, first node only.
+};
+
+_Static_assert(sizeof(struct node_t) >= sizeof(struct node_pool_obj),
+	       "struct node_t too small for node pool");
+
+pthread_mutex_t node_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+struct node_pool_obj *node_pool_depot; // Full batches, protected by lock.
+
+__thread struct node_pool_obj *node_pool_alloc_list;
+__thread struct node_pool_obj *node_pool_free_list;
+__thread long node_pool_free_n;
+
+// Get a full batch from the depot, or carve one from a new slab.
+struct node_pool_obj *node_pool_refill(void)
+{
+	struct node_pool_obj *head;
+	char *slab;
+	long sz = node_size();
+	int i;
+
+	pthread_mutex_lock(&node_pool_lock);
+	head = node_pool_depot;
+	if (head)
+		node_pool_depot = atomic_load_explicit(&head->nextbatch,
+						       memory_order_relaxed);
+	pthread_mutex_unlock(&node_pool_lock);
+	if (head)
+		return head;
+	slab = malloc(sz * NODE_POOL_BATCH);
+	if (!slab) {
+		perror("malloc");
+		abort();
+	}
+	for (i = 0; i < NODE_POOL_BATCH - 1; i++)
+		((struct node_pool_obj *)&slab[i * sz])->next =
+			(struct node_pool_obj *)&slab[(i + 1) * sz];
+	((struct node_pool_obj *)&slab[i * sz])->next = NULL;
+	return (struct node_pool_obj *)slab;
+}
+
+struct node_t *node_alloc(void)
+{
+	struct node_pool_obj *o = node_pool_alloc_list;
+
+	if (!o) {
+		// Prefer nodes this thread freed, which are likely cache-hot.
+		o = node_pool_free_list;
+		if (o) {
+			node_pool_free_list = NULL;
+			node_pool_free_n = 0;
+		} else {
+			o = node_pool_refill();
+		}
+	}
+	node_pool_alloc_list = o->next;
+	return node_payload_fill((struct node_t *)o);
+}
+
+void node_free(struct node_t *p)
+{
+	struct node_pool_obj *o = (struct node_pool_obj *)p;
+
+	if (node_caller_owned)
+		return;
+	o->next = node_pool_free_list;
+	node_pool_free_list = o;
+	if (++node_pool_free_n < NODE_POOL_BATCH)
+		return;
+
+	// Batch is full, so return it to the depot for the pushers.
+	pthread_mutex_lock(&node_pool_lock);
+	atomic_store_explicit(&o->nextbatch, node_pool_depot,
+			      memory_order_relaxed);
+	node_pool_depot = o;
+	pthread_mutex_unlock(&node_pool_lock);
+	node_pool_free_list = NULL;
+	node_pool_free_n = 0;
+}
+
+#else /* #ifdef NODE_POOL */
+
+struct node_t *node_alloc(void)
+{
+	struct node_t *p = malloc(node_size());
+
+	if (!p) {
+		perror("malloc");
+		abort();
+	}
+	return node_payload_fill(p);
+}
+
+void node_free(struct node_t *p)
+{
+	if (!node_caller_owned)
+		free(p);
+}
+
+#endif /* #else #ifdef NODE_POOL */
@@ -19,6 +19,8 @@ struct node_t {
 	struct node_t *_Atomic next;
 };
 
+#include "lifo-alloc.h"
+
 void set_value(struct node_t *p, value_t v)
 {
 	p->val = v;
@@ -31,7 +33,7 @@ struct node_t *_Atomic top;
 
 void list_push(value_t v)
 {
-	struct node_t *newnode = (struct node_t *) malloc(sizeof(*newnode));
+	struct node_t *newnode = node_alloc();
 
 	set_value(newnode, v);
 	// This store is not a data race, just rejuvenating the pointer
@@ -41,6 +43,16 @@ void list_push(value_t v)
 	} while (!atomic_compare_exchange_weak(&top, &newnode->next, newnode));
 }
 
+// Push a private chain of nodes onto the list with a single CAS.
+void list_push_chain(struct node_t *first, struct node_t *last)
+{
+	// This store is not a data race, just rejuvenating the pointer
+	atomic_store_explicit(&last->next, atomic_load(&top), memory_order_relaxed);
+	do {
+		// last->next may have become invalid
+	} while (!atomic_compare_exchange_weak(&top, &last->next, first));
+}
+
 
 void list_pop_all()
 {
@@ -51,11 +63,12 @@ void list_pop_all()
 		struct node_t *next = atomic_load_explicit(&p->next, memory_order_relaxed);
 
 		foo(p);
-		free(p);
+		node_free(p);
 		p = next;
 	}
 }
 
 #define rcu_register_thread() do { } while (0)
 #define rcu_unregister_thread() do { } while (0)
+#define list_set_next(p, q) atomic_store_explicit(&(p)->next, (q), memory_order_relaxed)
 #include "lifo-stress.h"
@@ -6,6 +6,9 @@
 // what the code would look like if the C standard "rejuvenated" pointers
 // loaded and stored via atomic operations (including RMW atomics).
 // And uses weak atomics.
+//
+// Building with -DPUSH_COMBINE adds a flat-combining front end to the
+// push operations.
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,6 +23,8 @@ struct node_t {
 	struct node_t *_Atomic next;
 };
 
+#include "lifo-alloc.h"
+
 void set_value(struct node_t *p, value_t v)
 {
 	p->val = v;
@@ -30,16 +35,124 @@ void foo(struct node_t *p);
 // LIFO list structure
 struct node_t *_Atomic top;
 
+// Per-thread count of failed CASes on top, reported by the stress test.
+__thread unsigned long cas_failures;
+#define HAVE_CAS_STATS
+
+// Splice a private chain of nodes onto the list with a single successful CAS.
+void list_splice(struct node_t *first, struct node_t *last)
+{
+	// This store is not a data race, just rejuvenating the pointer
+	atomic_store_explicit(&last->next, atomic_load_explicit(&top, memory_order_relaxed), memory_order_relaxed);
+	while (!atomic_compare_exchange_weak_explicit(&top, &last->next, first, memory_order_release, memory_order_relaxed)) {
+		// last->next may have become invalid
+		cas_failures++;
+	}
+}
+
+#ifdef PUSH_COMBINE
+
+// Flat-combining front end for pushes, which reduces the cache-line
+// ping-pong on top under heavy contention.  A pusher whose first CAS
+// on top fails posts its chain in its own slot.  Whichever pusher then
+// acquires combine_lock gathers all posted chains into a single chain,
+// splices it onto top, and only then clears the slots, releasing their
+// pushers.  Threads beyond N_COMBINE_SLOTS simply splice directly.
+
+#define N_COMBINE_SLOTS 256
+
+struct combine_slot {
+	struct node_t *_Atomic first;
+	struct node_t *last;
+} __attribute__((__aligned__(64)));
+
+struct combine_slot combine_slot[N_COMBINE_SLOTS];
+int _Atomic combine_nslots;
+int _Atomic combine_lock;
+__thread int combine_idx = -1;
+
+void list_push_combine(struct node_t *first, struct node_t *last)
+{
+	struct combine_slot *csp;
+	int taken[N_COMBINE_SLOTS];
+	int i;
+	int n;
+	int nt = 0;
+
+	// Uncontended fast path.
+	atomic_store_explicit(&last->next, atomic_load_explicit(&top, memory_order_relaxed), memory_order_relaxed);
+	if (atomic_compare_exchange_weak_explicit(&top, &last->next, first, memory_order_release, memory_order_relaxed))
+		return;
+	cas_failures++;
+
+	if (combine_idx < 0)
+		combine_idx = atomic_fetch_add(&combine_nslots, 1);
+	if (combine_idx >= N_COMBINE_SLOTS) {
+		list_splice(first, last);
+		return;
+	}
+	csp = &combine_slot[combine_idx];
+	csp->last = last;
+	atomic_store_explicit(&csp->first, first, memory_order_release);
+	for (;;) {
+		if (!atomic_load_explicit(&csp->first, memory_order_acquire))
+			return; // Some other combiner pushed our chain.
+		if (!atomic_load_explicit(&combine_lock, memory_order_relaxed) &&
+		    !atomic_exchange_explicit(&combine_lock, 1, memory_order_acquire))
+			break;
+	}
+
+	// We are now the combiner, so gather all posted chains.
+	first = NULL;
+	n = atomic_load(&combine_nslots);
+	if (n > N_COMBINE_SLOTS)
+		n = N_COMBINE_SLOTS;
+	for (i = 0; i < n; i++) {
+		struct node_t *p = atomic_load_explicit(&combine_slot[i].first, memory_order_acquire);
+
+		if (!p)
+			continue;
+		if (first)
+			atomic_store_explicit(&last->next, p, memory_order_relaxed);
+		else
+			first = p;
+		last = combine_slot[i].last;
+		taken[nt++] = i;
+	}
+	if (first)
+		list_splice(first, last);
+	for (i = 0; i < nt; i++)
+		atomic_store_explicit(&combine_slot[taken[i]].first, NULL, memory_order_release);
+	atomic_store_explicit(&combine_lock, 0, memory_order_release);
+}
+
+#endif /* #ifdef PUSH_COMBINE */
+
 void list_push(value_t v)
 {
-	struct node_t *newnode = (struct node_t *) malloc(sizeof(*newnode));
+	struct node_t *newnode = node_alloc();
 
 	set_value(newnode, v);
+#ifdef PUSH_COMBINE
+	list_push_combine(newnode, newnode);
+#else /* #ifdef PUSH_COMBINE */
 	// This store is not a data race, just rejuvenating the pointer
 	atomic_store_explicit(&newnode->next, atomic_load_explicit(&top, memory_order_relaxed), memory_order_relaxed);
-	do {
+	while (!atomic_compare_exchange_weak_explicit(&top, &newnode->next, newnode, memory_order_release, memory_order_relaxed)) {
 		// newnode->next may have become invalid
-	} while (!atomic_compare_exchange_weak_explicit(&top, &newnode->next, newnode, memory_order_release, memory_order_relaxed));
+		cas_failures++;
+	}
+#endif /* #else #ifdef PUSH_COMBINE */
+}
+
+// Push a private chain of nodes onto the list with a single CAS.
+void list_push_chain(struct node_t *first, struct node_t *last)
+{
+#ifdef PUSH_COMBINE
+	list_push_combine(first, last);
+#else /* #ifdef PUSH_COMBINE */
+	list_splice(first, last);
+#endif /* #else #ifdef PUSH_COMBINE */
 }
 
 
@@ -52,11 +165,12 @@ void list_pop_all()
 		struct node_t *next = atomic_load_explicit(&p->next, memory_order_relaxed);
 
 		foo(p);
-		free(p);
+		node_free(p);
 		p = next;
 	}
 }
 
 #define rcu_register_thread() do { } while (0)
 #define rcu_unregister_thread() do { } while (0)
+#define list_set_next(p, q) atomic_store_explicit(&(p)->next, (q), memory_order_relaxed)
 #include "lifo-stress.h"
@@ -0,0 +1,219 @@
+// Adapted from lifo-push.c, bounding the number of nodes in the list.
+//
+// Capacity is tracked as credits rather than as a depth counter, which
+// would be a second contended cache line on every push.  Pushers take
+// credits from the global pool in chunks of up to LIST_CREDIT_CHUNK, so that
+// most pushes consume a thread-local credit, and each list_pop_all()
+// returns the credits for all the nodes it drained with a single atomic
+// add.  The bound is therefore exact, but "full" is approximate: a push
+// can find the list full while other pushers hold unused credits.
+//
+// list_try_push() and list_try_push_n() fail if the list is full, while
+// list_push() and list_push_n() instead park the pusher on an eventcount
+// until poppers return enough credits.  A pusher that finds the list full
+// first gives back its own credits, whether it then fails or parks, so
+// pushers cannot starve each other by holding partial batches.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "eventcount.h"
+
+typedef char *value_t;
+
+struct node_t {
+	value_t val;
+	struct node_t *next;
+};
+
+#include "lifo-alloc.h"
+
+void set_value(struct node_t *p, value_t v)
+{
+	p->val = v;
+}
+
+void foo(struct node_t *p);
+
+// LIFO list structure
+struct node_t* _Atomic top;
+
+#ifndef LIST_CAPACITY
+#define LIST_CAPACITY (1024 * 1024)
+#endif
+#define LIST_CREDIT_CHUNK 64
+
+long list_capacity = LIST_CAPACITY;
+long list_credit_chunk = LIST_CREDIT_CHUNK; // At most 1/16th of capacity.
+long _Atomic list_credits = LIST_CAPACITY; // Unclaimed capacity.
+__thread long my_credits; // Capacity claimed by this thread.
+struct eventcount list_full_ec; // Pushers waiting for credits.
+unsigned long _Atomic list_nfull; // Failed list_try_push*() calls.
+unsigned long _Atomic list_nblocks; // Blocking pushes that had to wait.
+#define HAVE_LIST_BOUND
+
+// Must be called before any pushes.
+void list_set_capacity(long n)
+{
+	list_capacity = n;
+	list_credit_chunk = n / 16 < LIST_CREDIT_CHUNK ? n / 16 : LIST_CREDIT_CHUNK;
+	atomic_store(&list_credits, n);
+}
+
+void list_return_credits(long n)
+{
+	if (!n)
+		return;
+	atomic_fetch_add(&list_credits, n);
+	if (ec_has_waiters(&list_full_ec))
+		ec_notify(&list_full_ec, INT_MAX);
+}
+
+// Consume n credits, claiming more from the global pool as needed.
+// Returns 0 if the list is full, unless block is set, in which case
+// waits for the poppers to return enough credits.
+int list_take_credits(long n, int block)
+{
+	unsigned int key;
+	long c;
+	long take;
+	long want;
+
+	while (my_credits < n) {
+		want = n - my_credits;
+		c = atomic_load_explicit(&list_credits, memory_order_relaxed);
+		while (c >= want) {
+			take = want + list_credit_chunk;
+			if (take > c)
+				take = c;
+			if (atomic_compare_exchange_weak(&list_credits, &c, c - take)) {
+				my_credits += take;
+				break;
+			}
+		}
+		if (my_credits >= n)
+			break;
+		list_return_credits(my_credits);
+		my_credits = 0;
+		if (!block) {
+			atomic_fetch_add_explicit(&list_nfull, 1, memory_order_relaxed);
+			return 0;
+		}
+		atomic_fetch_add_explicit(&list_nblocks, 1, memory_order_relaxed);
+		key = ec_prepare(&list_full_ec);
+		if (atomic_load(&list_credits) >= n)
+			ec_cancel(&list_full_ec);
+		else
+			ec_wait(&list_full_ec, key);
+	}
+	my_credits -= n;
+	return 1;
+}
+
+void list_push_node(struct node_t *newnode)
+{
+	struct node_t *old = atomic_load(&top);
+
+	do {
+		newnode->next = old;
+	} while (!atomic_compare_exchange_weak(&top, &old, newnode));
+}
+
+int list_try_push(value_t v)
+{
+	struct node_t *newnode;
+
+	if (!list_take_credits(1, 0))
+		return 0;
+	newnode = node_alloc();
+	set_value(newnode, v);
+	list_push_node(newnode);
+	return 1;
+}
+
+void list_push(value_t v)
+{
+	struct node_t *newnode;
+
+	list_take_credits(1, 1);
+	newnode = node_alloc();
+	set_value(newnode, v);
+	list_push_node(newnode);
+}
+
+// Push a private chain of nodes onto the list with a single CAS.
+void list_push_chain(struct node_t *first, struct node_t *last)
+{
+	struct node_t *old = atomic_load(&top);
+
+	do {
+		last->next = old;
+	} while (!atomic_compare_exchange_weak(&top, &old, first));
+}
+
+// Defined in lifo-stress.h, which is included last.
+struct node_t *list_build_chain(value_t *v, long n, struct node_t **lastp);
+
+int list_try_push_n(value_t *v, long n)
+{
+	struct node_t *first;
+	struct node_t *last = NULL; // Set by list_build_chain() when n > 0.
+
+	if (n <= 0)
+		return 1;
+	if (!list_take_credits(n, 0))
+		return 0;
+	first = list_build_chain(v, n, &last);
+	list_push_chain(first, last);
+	return 1;
+}
+
+#define HAVE_LIST_PUSH_N
+void list_push_n(value_t *v, long n)
+{
+	struct node_t *first;
+	struct node_t *last = NULL; // Set by list_build_chain() when n > 0.
+
+	if (n <= 0)
+		return;
+	list_take_credits(n, 1);
+	first = list_build_chain(v, n, &last);
+	list_push_chain(first, last);
+}
+
+
+void list_pop_all()
+{
+	struct node_t *p = atomic_exchange(&top, NULL);
+	long n = 0;
+
+	while (p) {
+		struct node_t *next = p->next;
+
+		foo(p);
+		node_free(p);
+		p = next;
+		n++;
+	}
+	list_return_credits(n);
+}
+
+void list_stats(void)
+{
+	printf("Capacity %ld: %lu failed try-pushes, %lu blocked pushes\n",
+	       list_capacity, atomic_load(&list_nfull),
+	       atomic_load(&list_nblocks));
+}
+#define HAVE_LIST_STATS
+
+// Exiting pushers give back their unused credits.
+#define rcu_register_thread() do { } while (0)
+#define rcu_unregister_thread() \
+do { \
+	list_return_credits(my_credits); \
+	my_credits = 0; \
+} while (0)
+#include "lifo-stress.h"
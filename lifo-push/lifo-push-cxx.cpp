@@ -0,0 +1,95 @@
+// Exercise the C++ lists from lifo.hpp, which the C stress test cannot.
+//
+// For each memory-order policy, pushers push intrusive nodes onto a
+// lifo<> and boxed values onto a boxed_lifo<>, one at a time and in
+// chains, while poppers drain both.  Each value must be popped exactly
+// once.  Usage: lifo-push-cxx [ npushers [ npoppers [ nelem ] ] ]
+
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "lifo.hpp"
+
+struct item {
+	long val;
+	item *link;
+};
+
+long n_push = 2;
+long n_pop = 2;
+long n_elem = 100000;
+
+template <typename MO> int check(const char *name)
+{
+	lifo<item, &item::link, lifo_reclaim_none, MO> l;
+	boxed_lifo<long, MO> bl;
+	std::vector<item> items(n_push * n_elem);
+	std::vector<std::atomic<int>> seen(n_push * n_elem);
+	std::vector<std::atomic<int>> seen_boxed(n_push * n_elem);
+	std::atomic<long> npushers_done{0};
+	std::vector<std::thread> threads;
+	long errors = 0;
+
+	for (long i = 0; i < n_push; i++) {
+		threads.emplace_back([&, i] {
+			for (long j = 0; j < n_elem; j++) {
+				long v = i * n_elem + j;
+
+				items[v].val = v;
+				// Push every other pair of items as a chain.
+				if (j & 1) {
+					items[v - 1].link = &items[v];
+					l.push_chain(&items[v - 1], &items[v]);
+				} else if (j == n_elem - 1) {
+					l.push(&items[v]);
+				}
+				bl.push(v);
+			}
+			npushers_done++;
+		});
+	}
+	for (long i = 0; i < n_pop; i++) {
+		threads.emplace_back([&] {
+			for (;;) {
+				bool done = npushers_done.load() == n_push;
+
+				l.drain([&](item *p) { seen[p->val]++; });
+				bl.drain([&](long v) { seen_boxed[v]++; });
+				if (done && l.empty() && bl.empty())
+					break;
+			}
+		});
+	}
+	for (auto &t : threads)
+		t.join();
+	for (long v = 0; v < n_push * n_elem; v++)
+		if (seen[v] != 1 || seen_boxed[v] != 1)
+			errors++;
+	printf("lifo-push-cxx %s: %ld of %ld values popped other than once\n",
+	       name, errors, n_push * n_elem);
+	return errors != 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret = 0;
+
+	if (argc > 1)
+		n_push = strtol(argv[1], NULL, 0);
+	if (argc > 2)
+		n_pop = strtol(argv[2], NULL, 0);
+	if (argc > 3)
+		n_elem = strtol(argv[3], NULL, 0);
+	if (argc > 4 || n_push < 1 || n_pop < 1 || n_elem < 1) {
+		fprintf(stderr, "Usage: %s [ npushers [ npoppers [ nelem ] ] ]\n",
+			argv[0]);
+		exit(1);
+	}
+	ret |= check<lifo_seq_cst>("seq_cst");
+	ret |= check<lifo_acq_rel>("acq_rel");
+	ret |= check<lifo_relaxed>("relaxed");
+	return ret;
+}
@@ -0,0 +1,94 @@
+// Adapted from lifo-push.c, adding epoch-based-reclamation protection
+// from ABA, using ../common/ebr.h rather than liburcu.
+//
+// As with lifo-push-rcu.c, pushers run in read-side critical sections,
+// so the snapshot of top cannot be freed before the CAS.  Unlike
+// lifo-push-rcu.c, list_pop_all() retires the entire detached chain as
+// a single object, so a drain costs one deferred free.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// Each retired object is an entire chain, so try to advance often.
+#define EBR_BATCH 16
+#include "ebr.h"
+
+typedef char *value_t;
+
+struct node_t {
+	value_t val;
+	struct node_t *next;
+};
+
+#include "lifo-alloc.h"
+
+void set_value(struct node_t *p, value_t v)
+{
+	p->val = v;
+}
+
+void foo(struct node_t *p);
+
+// LIFO list structure
+struct node_t* _Atomic top;
+
+void list_push(value_t v)
+{
+	struct node_t *newnode = node_alloc();
+
+	set_value(newnode, v);
+	ebr_read_lock();
+	newnode->next = atomic_load(&top);
+	do {
+		// newnode->next may have been removed from the list, but
+		// EBR prevents it from being freed.  Thus this pointer
+		// remains valid throughout.
+	} while (!atomic_compare_exchange_weak(&top, &newnode->next, newnode));
+	ebr_read_unlock();
+}
+
+// Push a private chain of nodes onto the list with a single CAS.
+void list_push_chain(struct node_t *first, struct node_t *last)
+{
+	ebr_read_lock();
+	last->next = atomic_load(&top);
+	do {
+		// As in list_push(), EBR keeps last->next valid.
+	} while (!atomic_compare_exchange_weak(&top, &last->next, first));
+	ebr_read_unlock();
+}
+
+
+// EBR callback to free a detached chain of nodes.
+void free_chain(void *vp)
+{
+	struct node_t *p = vp;
+
+	while (p) {
+		struct node_t *next = p->next;
+
+		node_free(p);
+		p = next;
+	}
+}
+
+void list_pop_all()
+{
+	struct node_t *p = atomic_exchange(&top, NULL);
+	struct node_t *q;
+
+	if (!p)
+		return;
+	for (q = p; q; q = q->next)
+		foo(q);
+	ebr_retire(p, free_chain);
+}
+
+#define rcu_register_thread() ebr_register_thread()
+#define rcu_unregister_thread() ebr_unregister_thread()
+#define lifo_pop_register_thread() ebr_register_thread()
+#define lifo_pop_unregister_thread() ebr_unregister_thread()
+#include "lifo-stress.h"
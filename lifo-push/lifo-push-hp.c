@@ -0,0 +1,195 @@
+// Adapted from lifo-push.c, adding hazard-pointer protection from ABA.
+//
+// Each pusher publishes a hazard pointer to its snapshot of top
+// before using that snapshot as the new node's ->next pointer.
+// Poppers retire nodes rather than freeing them, and periodically
+// scan the hazard pointers, freeing only those retired nodes that
+// no pusher is protecting.  The snapshot therefore cannot be freed
+// and reallocated before the CAS, so the algorithm never sees an
+// indeterminate pointer.  Unlike lifo-push-rcu.c, the cost of
+// reclamation is amortized over HP_RETIRE_BATCH nodes rather than
+// incurring a grace period per node.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+typedef char *value_t;
+
+struct node_t {
+	value_t val;
+	struct node_t *next;
+};
+
+#include "lifo-alloc.h"
+
+void set_value(struct node_t *p, value_t v)
+{
+	p->val = v;
+}
+
+void foo(struct node_t *p);
+
+// LIFO list structure
+struct node_t* _Atomic top;
+
+////////////////////////////////////////////////////////////////////////
+//
+// Hazard pointers, one per registered thread.
+
+#define N_HP_SLOTS 256
+#define HP_RETIRE_BATCH 1024 // Must exceed N_HP_SLOTS to make progress.
+
+struct hp_slot {
+	struct node_t *_Atomic hp;
+	int _Atomic inuse;
+} __attribute__((__aligned__(64)));
+
+struct hp_slot hp_slot[N_HP_SLOTS];
+int _Atomic hp_nslots; // High-water mark of slots ever used.
+__thread struct hp_slot *hp_me;
+
+__thread struct node_t *hp_rlist[HP_RETIRE_BATCH];
+__thread int hp_rcount;
+
+void hp_register_thread(void)
+{
+	int i;
+	int n;
+
+	for (i = 0; i < N_HP_SLOTS; i++) {
+		int expected = 0;
+
+		if (atomic_compare_exchange_strong(&hp_slot[i].inuse, &expected, 1))
+			break;
+	}
+	if (i >= N_HP_SLOTS) {
+		fprintf(stderr, "Out of hazard-pointer slots\n");
+		abort();
+	}
+	hp_me = &hp_slot[i];
+	n = atomic_load(&hp_nslots);
+	while (n <= i && !atomic_compare_exchange_weak(&hp_nslots, &n, i + 1))
+		continue;
+}
+
+void hp_unregister_thread(void)
+{
+	atomic_store(&hp_me->hp, NULL);
+	atomic_store(&hp_me->inuse, 0);
+	hp_me = NULL;
+}
+
+// Return a snapshot of top that cannot be freed until our hazard
+// pointer is cleared or overwritten.
+struct node_t *hp_protect_top(void)
+{
+	struct node_t *p = atomic_load(&top);
+	struct node_t *q;
+
+	for (;;) {
+		atomic_store(&hp_me->hp, p);
+		q = atomic_load(&top);
+		if (q == p)
+			return p;
+		p = q;
+	}
+}
+
+void hp_clear(void)
+{
+	atomic_store_explicit(&hp_me->hp, NULL, memory_order_release);
+}
+
+int hp_cmp(const void *a, const void *b)
+{
+	uintptr_t x = (uintptr_t)*(struct node_t *const *)a;
+	uintptr_t y = (uintptr_t)*(struct node_t *const *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+// Free all retired nodes that are not protected by a hazard pointer.
+void hp_scan(void)
+{
+	struct node_t *plist[N_HP_SLOTS];
+	int i;
+	int j;
+	int n = atomic_load(&hp_nslots);
+	int np = 0;
+
+	for (i = 0; i < n; i++) {
+		struct node_t *p = atomic_load(&hp_slot[i].hp);
+
+		if (p)
+			plist[np++] = p;
+	}
+	qsort(plist, np, sizeof(plist[0]), hp_cmp);
+	for (i = 0, j = 0; i < hp_rcount; i++) {
+		if (np && bsearch(&hp_rlist[i], plist, np, sizeof(plist[0]), hp_cmp))
+			hp_rlist[j++] = hp_rlist[i];
+		else
+			node_free(hp_rlist[i]);
+	}
+	hp_rcount = j;
+}
+
+void hp_retire(struct node_t *p)
+{
+	hp_rlist[hp_rcount++] = p;
+	if (hp_rcount >= HP_RETIRE_BATCH)
+		hp_scan();
+}
+
+////////////////////////////////////////////////////////////////////////
+
+void list_push(value_t v)
+{
+	struct node_t *newnode = node_alloc();
+	struct node_t *oldtop;
+
+	set_value(newnode, v);
+	do {
+		// The hazard pointer prevents oldtop from being freed,
+		// so it remains valid throughout.
+		oldtop = hp_protect_top();
+		newnode->next = oldtop;
+	} while (!atomic_compare_exchange_weak(&top, &oldtop, newnode));
+	hp_clear();
+}
+
+// Push a private chain of nodes onto the list with a single CAS.
+void list_push_chain(struct node_t *first, struct node_t *last)
+{
+	struct node_t *oldtop;
+
+	do {
+		oldtop = hp_protect_top();
+		last->next = oldtop;
+	} while (!atomic_compare_exchange_weak(&top, &oldtop, first));
+	hp_clear();
+}
+
+
+void list_pop_all()
+{
+	struct node_t *p = atomic_exchange(&top, NULL);
+
+	while (p) {
+		struct node_t *next = p->next;
+
+		foo(p);
+		hp_retire(p);
+		p = next;
+	}
+}
+
+#define rcu_register_thread() hp_register_thread()
+#define rcu_unregister_thread() hp_unregister_thread()
+// Poppers exit after all pushers, so no hazard pointers remain, and this
+// frees all of their remaining retired nodes.
+#define lifo_pop_unregister_thread() hp_scan()
+#include "lifo-stress.h"
@@ -44,6 +44,8 @@ static inline struct node_t * node_int2ptr(struct node_ptr_t p)
 	return (struct node_t *)p.i;
 }
 
+#include "lifo-alloc.h"
+
 void set_value(struct node_t *p, value_t v)
 {
 	p->val = v;
@@ -62,7 +64,7 @@ struct node_ptr_t _Atomic top;
 
 void list_push(value_t v)
 {
-	struct node_t *newnode = (struct node_t *) malloc(sizeof(*newnode));
+	struct node_t *newnode = node_alloc();
 
 	set_value(newnode, v);
 	newnode->next = NODE_INT(NULL);
@@ -95,6 +97,17 @@ void list_push(value_t v)
 	} while (!atomic_compare_exchange_weak(&top, &newnode->next, NODE_INT(newnode)));
 }
 
+// Push a private chain of nodes onto the list with a single CAS.
+void list_push_chain(struct node_t *first, struct node_t *last)
+{
+	last->next = NODE_INT(NULL);
+
+	do {
+		/* See the comment in list_push(), which applies equally
+		 * to the chain's last node. */
+	} while (!atomic_compare_exchange_weak(&top, &last->next, NODE_INT(first)));
+}
+
 
 void list_pop_all(void)
 {
@@ -121,11 +134,12 @@ void list_pop_all(void)
 		struct node_t *next = NODE_PTR(p->next);
 
 		foo(p);
-		free(p);
+		node_free(p);
 		p = next;
 	}
 }
 
 #define rcu_register_thread() do { } while (0)
 #define rcu_unregister_thread() do { } while (0)
+#define list_set_next(p, q) ((p)->next = NODE_INT(q))
 #include "lifo-stress.h"
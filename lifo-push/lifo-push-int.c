@@ -20,6 +20,8 @@ struct node_t {
 	uintptr_t next;
 };
 
+#include "lifo-alloc.h"
+
 void set_value(struct node_t *p, value_t v)
 {
 	p->val = v;
@@ -38,7 +40,7 @@ uintptr_t _Atomic top;
 
 void list_push(value_t v)
 {
-	struct node_t *newnode = (struct node_t *) malloc(sizeof(*newnode));
+	struct node_t *newnode = node_alloc();
 
 	set_value(newnode, v);
 	newnode->next = (uintptr_t)NULL;
@@ -52,6 +54,15 @@ void list_push(value_t v)
 	} while (!atomic_compare_exchange_weak(&top, &newnode->next, (uintptr_t)newnode));
 }
 
+// Push a private chain of nodes onto the list with a single CAS.
+void list_push_chain(struct node_t *first, struct node_t *last)
+{
+	last->next = (uintptr_t)NULL;
+	do {
+		// See the comment in list_push().
+	} while (!atomic_compare_exchange_weak(&top, &last->next, (uintptr_t)first));
+}
+
 
 void list_pop_all()
 {
@@ -61,11 +72,12 @@ void list_pop_all()
 		struct node_t *next = (struct node_t *)p->next;
 
 		foo(p);
-		free(p);
+		node_free(p);
 		p = next;
 	}
 }
 
 #define rcu_register_thread() do { } while (0)
 #define rcu_unregister_thread() do { } while (0)
+#define list_set_next(p, q) ((p)->next = (uintptr_t)(q))
 #include "lifo-stress.h"
@@ -0,0 +1,70 @@
+// Adapted from lifo-push.c, using the generic list from lifo.h.
+//
+// The harness's struct node_t serves as the intrusive node type, and
+// nodes come from lifo-alloc.h, so reclamation policy "none" applies.
+// Build with -DLIFO_MO=acq_rel for release/acquire rather than
+// sequentially consistent ordering.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "lifo.h"
+
+#ifndef LIFO_MO
+#define LIFO_MO seq_cst
+#endif
+
+typedef char *value_t;
+
+struct node_t {
+	value_t val;
+	struct node_t *next;
+};
+
+#include "lifo-alloc.h"
+
+void set_value(struct node_t *p, value_t v)
+{
+	p->val = v;
+}
+
+void foo(struct node_t *p);
+
+LIFO_DEFINE(lifo, struct node_t, next, LIFO_MO, none)
+
+// LIFO list structure
+struct lifo top;
+
+#define list_empty(l) lifo_empty(&(l))
+
+void list_push(value_t v)
+{
+	struct node_t *newnode = node_alloc();
+
+	set_value(newnode, v);
+	lifo_push(&top, newnode);
+}
+
+// Push a private chain of nodes onto the list with a single CAS.
+void list_push_chain(struct node_t *first, struct node_t *last)
+{
+	lifo_push_chain(&top, first, last);
+}
+
+void list_consume(struct node_t *p)
+{
+	foo(p);
+	node_free(p);
+}
+
+void list_pop_all()
+{
+	lifo_drain(&top, list_consume);
+}
+
+#define rcu_register_thread() do { } while (0)
+#define rcu_unregister_thread() do { } while (0)
+#include "lifo-stress.h"
@@ -0,0 +1,107 @@
+#!/bin/bash
+#
+# Run the memory-order and optimization sweep built by "make matrix",
+# tabulating the median ops/sec of each program at each optimization
+# level.
+#
+# Usage: lifo-push-matrix.sh [ --iterations N ] [ --threads "1 2 4 ..." ]
+#			     [ lifo-stress arguments, for example, -z ]
+#
+# Each program in the matrix directory is run with each of the specified
+# numbers of pushers, using the same number of poppers.  The raw result
+# records are saved in matrix/results.csv and the output of
+# ../common/reduce.sh in matrix/summary.csv, whose speedups are relative
+# to the unoptimized lifo-push.  The table printed at the end has one row
+# per program and set of parameters, and one column per optimization
+# level.  Comparing lifo-push-lib-seq_cst, -acq_rel and -relaxed (or
+# lifo-push-atomic and lifo-push-atomicw) within a column gives the cost
+# of the stronger memory orderings.
+#
+# Copyright IBM Corporation, 2019
+# Authors: Paul E. McKenney, IBM Linux Technology Center
+
+iterations=10
+ncpus=`nproc`
+threads=1
+for ((t=2;t*2<=ncpus;t*=2))
+do
+	threads="$threads $t"
+done
+while test $# -gt 0
+do
+	case "$1" in
+	--iterations)
+		iterations=$2
+		shift 2
+		;;
+	--threads)
+		threads="$2"
+		shift 2
+		;;
+	*)
+		break
+		;;
+	esac
+done
+
+pgms=`ls matrix/lifo-push*.O0 matrix/lifo-push*.O2 matrix/lifo-push*.O3 matrix/lifo-push*.native 2> /dev/null`
+if test -z "$pgms"
+then
+	echo "No matrix builds found, so do \"make matrix\" first." 1>&2
+	exit 1
+fi
+
+ret=0
+rm -f matrix/results.csv
+for ((i=0;i<iterations;i++))
+do
+	for t in $threads
+	do
+		for pgm in $pgms
+		do
+			echo Running $pgm iteration $i threads $t 1>&2
+			$pgm -p $t -c $t -o csv "$@" | grep '^result,' >> matrix/results.csv
+			status=("${PIPESTATUS[@]}")
+			if test "${status[0]}" -ne 0
+			then
+				echo "!!! $pgm -p $t -c $t failed with status ${status[0]}" 1>&2
+				ret=1
+			elif test "${status[1]}" -ne 0
+			then
+				echo "!!! $pgm -p $t -c $t emitted no result record" 1>&2
+				ret=1
+			fi
+		done
+	done
+done
+
+../common/reduce.sh -b lifo-push.O0 < matrix/results.csv > matrix/summary.csv
+
+# Pivot the summary into one column per optimization level.
+awk -F, '
+NR > 1 {
+	n = split($1, part, ".");
+	opt = part[n];
+	pgm = substr($1, 1, length($1) - length(opt) - 1);
+	row = pgm "," $2;
+	if (!(row in seen)) {
+		seen[row] = 1;
+		rows[++nrows] = row;
+	}
+	med[row, opt] = $4;
+}
+
+END {
+	nopts = split("O0 O2 O3 native", opts, " ");
+	printf "program,params";
+	for (j = 1; j <= nopts; j++)
+		printf ",%s", opts[j];
+	printf "\n";
+	for (i = 1; i <= nrows; i++) {
+		printf "%s", rows[i];
+		for (j = 1; j <= nopts; j++)
+			printf ",%s", (rows[i], opts[j]) in med ? med[rows[i], opts[j]] : "";
+		printf "\n";
+	}
+}' matrix/summary.csv
+exit $ret
@@ -6,6 +6,10 @@
 //	more expensive) than strictly required, but it has the useful
 //	side-effect of preventing the algorithm from seeing indeterminate
 //	pointers.
+//
+//	Building with -DRCU_BATCH instead has list_pop_all() wait for
+//	only one grace period per detached chain rather than per node.
+//	Building with -DDO_QSBR uses QSBR rather than signal-based RCU.
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,6 +33,8 @@ struct node_t {
 	struct node_t *next;
 };
 
+#include "lifo-alloc.h"
+
 void set_value(struct node_t *p, value_t v)
 {
 	p->val = v;
@@ -41,7 +47,7 @@ struct node_t* _Atomic top;
 
 void list_push(value_t v)
 {
-	struct node_t *newnode = (struct node_t *) malloc(sizeof(*newnode));
+	struct node_t *newnode = node_alloc();
 
 	set_value(newnode, v);
 	rcu_read_lock();
@@ -54,6 +60,41 @@ void list_push(value_t v)
 	rcu_read_unlock();
 }
 
+// Push a private chain of nodes onto the list with a single CAS.
+void list_push_chain(struct node_t *first, struct node_t *last)
+{
+	rcu_read_lock();
+	last->next = atomic_load(&top);
+	do {
+		// As in list_push(), RCU keeps last->next valid.
+	} while (!atomic_compare_exchange_weak(&top, &last->next, first));
+	rcu_read_unlock();
+}
+
+
+#ifdef RCU_BATCH
+
+// Process the whole detached chain, then wait for a single grace
+// period before freeing all of it.
+void list_pop_all()
+{
+	struct node_t *p = atomic_exchange(&top, NULL);
+	struct node_t *q;
+
+	if (!p)
+		return;
+	for (q = p; q; q = q->next)
+		foo(q);
+	synchronize_rcu();
+	while (p) {
+		struct node_t *next = p->next;
+
+		node_free(p);
+		p = next;
+	}
+}
+
+#else /* #ifdef RCU_BATCH */
 
 void list_pop_all()
 {
@@ -64,9 +105,16 @@ void list_pop_all()
 
 		foo(p);
 		synchronize_rcu();
-		free(p);
+		node_free(p);
 		p = next;
 	}
 }
 
+#endif /* #else #ifdef RCU_BATCH */
+
+#ifdef DO_QSBR
+// QSBR readers must announce quiescent states or grace periods stall.
+#define lifo_quiescent_state() rcu_quiescent_state()
+#endif /* #ifdef DO_QSBR */
+
 #include "lifo-stress.h"
@@ -28,6 +28,8 @@ struct node_t {
 	struct PointerRep next;
 };
 
+#include "lifo-alloc.h"
+
 void set_value(struct node_t *p, value_t v)
 {
 	p->val = v;
@@ -46,7 +48,7 @@ struct PointerRep _Atomic top;
 
 void list_push(value_t v)
 {
-	struct node_t *newnode = (struct node_t *) malloc(sizeof(*newnode));
+	struct node_t *newnode = node_alloc();
 	struct PointerRep newnodepr;
 
 	set_value(newnode, v);
@@ -64,6 +66,18 @@ void list_push(value_t v)
 	} while (!atomic_compare_exchange_weak(&top, &newnode->next, newnodepr));
 }
 
+// Push a private chain of nodes onto the list with a single CAS.
+void list_push_chain(struct node_t *first, struct node_t *last)
+{
+	struct PointerRep firstpr;
+
+	last->next = NULLpr;
+	memcpy(&firstpr, &first, sizeof(firstpr));
+	do {
+		// See the comment in list_push().
+	} while (!atomic_compare_exchange_weak(&top, &last->next, firstpr));
+}
+
 
 void list_pop_all()
 {
@@ -76,11 +90,12 @@ void list_pop_all()
 
 		next = p->next;
 		foo(p);
-		free(p);
+		node_free(p);
 		memcpy(&p, &next, sizeof(p));
 	}
 }
 
 #define rcu_register_thread() do { } while (0)
 #define rcu_unregister_thread() do { } while (0)
+#define list_set_next(p, q) memcpy(&(p)->next, &(q), sizeof((p)->next))
 #include "lifo-stress.h"
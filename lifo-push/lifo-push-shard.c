@@ -0,0 +1,172 @@
+// Adapted from lifo-push.c, sharding the list across per-thread stacks.
+//
+// Each pushing thread is assigned one of N_SHARDS cache-line-aligned
+// stack heads and pushes only onto that one, so pushers on different
+// shards never contend.  Each popping thread is assigned a home shard
+// among those in use, and list_pop_all() drains the home shard first,
+// then steals from the others.  This trades strict LIFO ordering for
+// near-linear push scalability.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+typedef char *value_t;
+
+struct node_t {
+	value_t val;
+	struct node_t *next;
+};
+
+#include "lifo-alloc.h"
+
+void set_value(struct node_t *p, value_t v)
+{
+	p->val = v;
+}
+
+void foo(struct node_t *p);
+
+#define N_SHARDS 64
+
+struct shard {
+	struct node_t *_Atomic top;
+} __attribute__((__aligned__(64)));
+
+// Statistics for each shard, kept off the cache line that pushers CAS.
+struct shard_stats {
+	unsigned long _Atomic ndrains;	// Non-empty drains of this shard.
+	unsigned long _Atomic nnodes;	// Nodes drained from this shard.
+	unsigned long _Atomic nstolen;	// Of which by non-home poppers.
+} __attribute__((__aligned__(64)));
+
+// LIFO list structure, one per shard.
+struct shard top[N_SHARDS];
+struct shard_stats shard_stats[N_SHARDS];
+int _Atomic next_push_shard;
+int _Atomic next_pop_shard;
+__thread struct shard *my_push_shard;
+__thread int my_pop_idx = -1;
+
+int list_nshards(void)
+{
+	int n = atomic_load(&next_push_shard);
+
+	return n > N_SHARDS ? N_SHARDS : n;
+}
+
+int list_empty(struct shard *sp)
+{
+	int i;
+	int n = list_nshards();
+
+	for (i = 0; i < n; i++)
+		if (atomic_load(&sp[i].top))
+			return 0;
+	return 1;
+}
+#define list_empty(p) list_empty(p)
+
+struct shard *list_push_shard(void)
+{
+	if (!my_push_shard)
+		my_push_shard = &top[atomic_fetch_add(&next_push_shard, 1) % N_SHARDS];
+	return my_push_shard;
+}
+
+void list_push(value_t v)
+{
+	struct node_t *newnode = node_alloc();
+	struct shard *sp = list_push_shard();
+
+	set_value(newnode, v);
+	newnode->next = atomic_load(&sp->top);
+	do {
+		// newnode->next may have become invalid
+	} while (!atomic_compare_exchange_weak(&sp->top, &newnode->next, newnode));
+}
+
+// Push a private chain of nodes onto this thread's shard with a single CAS.
+void list_push_chain(struct node_t *first, struct node_t *last)
+{
+	struct shard *sp = list_push_shard();
+
+	last->next = atomic_load(&sp->top);
+	do {
+		// last->next may have become invalid
+	} while (!atomic_compare_exchange_weak(&sp->top, &last->next, first));
+}
+
+// Drain one shard, returning the number of nodes processed.
+unsigned long list_pop_shard(struct shard *sp, int stolen)
+{
+	struct node_t *p;
+	unsigned long n = 0;
+
+	// Avoid pulling the cache line away from pushers if empty.
+	if (!atomic_load_explicit(&sp->top, memory_order_relaxed))
+		return 0;
+	p = atomic_exchange(&sp->top, NULL);
+	while (p) {
+		struct node_t *next = p->next;
+
+		foo(p);
+		node_free(p);
+		p = next;
+		n++;
+	}
+	if (n) {
+		struct shard_stats *ssp = &shard_stats[sp - top];
+
+		atomic_fetch_add_explicit(&ssp->ndrains, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&ssp->nnodes, n, memory_order_relaxed);
+		if (stolen)
+			atomic_fetch_add_explicit(&ssp->nstolen, n, memory_order_relaxed);
+	}
+	return n;
+}
+
+// Drain this thread's home shard, then steal from all the others.
+void list_pop_all()
+{
+	int home;
+	int i;
+	int n = list_nshards();
+
+	if (!n)
+		return;
+	if (my_pop_idx < 0)
+		my_pop_idx = atomic_fetch_add(&next_pop_shard, 1);
+	home = my_pop_idx % n;
+	for (i = 0; i < n; i++)
+		list_pop_shard(&top[(home + i) % n], i != 0);
+}
+
+// Print per-shard occupancy and steal counts.
+void list_stats(void)
+{
+	int i;
+	int n = list_nshards();
+	unsigned long stolen = 0;
+	unsigned long total = 0;
+
+	for (i = 0; i < n; i++) {
+		unsigned long nd = atomic_load(&shard_stats[i].ndrains);
+		unsigned long nn = atomic_load(&shard_stats[i].nnodes);
+		unsigned long ns = atomic_load(&shard_stats[i].nstolen);
+
+		printf("Shard %d: %lu nodes in %lu drains (%.1f per drain), %lu stolen\n",
+		       i, nn, nd, nd ? (double)nn / nd : 0., ns);
+		total += nn;
+		stolen += ns;
+	}
+	printf("Stolen: %lu of %lu nodes (%.1f%%)\n",
+	       stolen, total, total ? 100. * stolen / total : 0.);
+}
+#define HAVE_LIST_STATS
+
+#define rcu_register_thread() do { } while (0)
+#define rcu_unregister_thread() do { } while (0)
+#include "lifo-stress.h"
@@ -0,0 +1,130 @@
+// Adapted from lifo-push.c, pairing top with a generation number that
+// is incremented by every update, so that a double-width CAS on top
+// fails whenever top has changed, even if the same node has since been
+// freed, reallocated, and pushed again.  This ABA protection allows
+// list_pop_one() to remove a single node.
+//
+// list_pop_one() loads ->next from a node that might concurrently be
+// popped and freed by some other thread.  This variant therefore always
+// uses the type-stable node pool.  Every store to a node's ->next, both
+// here and by the pool's batch link that overlays it, is a relaxed
+// atomic, so that such a stale load is not a data race.  The stale
+// value is then discarded because the generation number causes the CAS
+// to fail.
+//
+// On x86 the double-width CAS is cmpxchg16b, provided via libatomic.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+typedef char *value_t;
+
+struct node_t {
+	value_t val;
+	struct node_t *_Atomic next;
+};
+
+#ifndef NODE_POOL
+#define NODE_POOL
+#endif
+#include "lifo-alloc.h"
+
+void set_value(struct node_t *p, value_t v)
+{
+	p->val = v;
+}
+
+void foo(struct node_t *p);
+
+struct tagged_ptr {
+	struct node_t *ptr;
+	uintptr_t gen;
+};
+
+int list_empty(struct tagged_ptr p)
+{
+	return p.ptr == NULL;
+}
+#define list_empty(p) list_empty(p)
+
+// LIFO list structure
+struct tagged_ptr _Atomic top;
+
+void list_push(value_t v)
+{
+	struct node_t *newnode = node_alloc();
+	struct tagged_ptr oldtop = atomic_load(&top);
+	struct tagged_ptr newtop;
+
+	set_value(newnode, v);
+	do {
+		atomic_store_explicit(&newnode->next, oldtop.ptr, memory_order_relaxed);
+		newtop.ptr = newnode;
+		newtop.gen = oldtop.gen + 1;
+	} while (!atomic_compare_exchange_weak(&top, &oldtop, newtop));
+}
+
+// Push a private chain of nodes onto the list with a single CAS.
+void list_push_chain(struct node_t *first, struct node_t *last)
+{
+	struct tagged_ptr oldtop = atomic_load(&top);
+	struct tagged_ptr newtop;
+
+	do {
+		atomic_store_explicit(&last->next, oldtop.ptr, memory_order_relaxed);
+		newtop.ptr = first;
+		newtop.gen = oldtop.gen + 1;
+	} while (!atomic_compare_exchange_weak(&top, &oldtop, newtop));
+}
+
+// Pop and process the top node, returning false if the list was empty.
+int list_pop_one(void)
+{
+	struct tagged_ptr oldtop = atomic_load(&top);
+	struct tagged_ptr newtop;
+
+	do {
+		if (!oldtop.ptr)
+			return 0;
+		// oldtop.ptr might already have been popped, freed, and
+		// even reused, in which case the CAS fails.
+		newtop.ptr = atomic_load_explicit(&oldtop.ptr->next, memory_order_relaxed);
+		newtop.gen = oldtop.gen + 1;
+	} while (!atomic_compare_exchange_weak(&top, &oldtop, newtop));
+	foo(oldtop.ptr);
+	node_free(oldtop.ptr);
+	return 1;
+}
+#define HAVE_LIST_POP_ONE
+
+void list_pop_all()
+{
+	struct tagged_ptr oldtop = atomic_load(&top);
+	struct tagged_ptr newtop;
+	struct node_t *p;
+
+	do {
+		if (!oldtop.ptr)
+			return;
+		newtop.ptr = NULL;
+		newtop.gen = oldtop.gen + 1;
+	} while (!atomic_compare_exchange_weak(&top, &oldtop, newtop));
+
+	p = oldtop.ptr;
+	while (p) {
+		struct node_t *next = atomic_load_explicit(&p->next, memory_order_relaxed);
+
+		foo(p);
+		node_free(p);
+		p = next;
+	}
+}
+
+#define rcu_register_thread() do { } while (0)
+#define rcu_unregister_thread() do { } while (0)
+#define list_set_next(p, q) atomic_store_explicit(&(p)->next, (q), memory_order_relaxed)
+#include "lifo-stress.h"
@@ -2,22 +2,60 @@
 #
 # Run a crude performance test of the various lifo-push implementations
 #
+# Usage: lifo-push-test.sh [ --iterations N ] [ --threads "1 2 4 ..." ]
+#			   [ lifo-stress arguments, for example, -b 16 ]
+#
+# Each variant is run with each of the specified numbers of pushers,
+# using the same number of poppers.  The default is powers of two up
+# to half the number of CPUs, yielding a scalability curve.  Each run
+# emits a CSV result record, so pipe the output into ../common/reduce.sh
+# for per-variant medians, confidence intervals and speedups.  Adding,
+# for example, "-W spin:1000" or "-W hash -B 512" gives the poppers
+# real per-element work.
+#
 # Copyright IBM Corporation, 2019
 # Authors: Paul E. McKenney, IBM Linux Technology Center
 
+iterations=50
+ncpus=`nproc`
+threads=1
+for ((t=2;t*2<=ncpus;t*=2))
+do
+	threads="$threads $t"
+done
+while test $# -gt 0
+do
+	case "$1" in
+	--iterations)
+		iterations=$2
+		shift 2
+		;;
+	--threads)
+		threads="$2"
+		shift 2
+		;;
+	*)
+		break
+		;;
+	esac
+done
+
 ret=0
-for ((i=0;i<50;i++))
+for ((i=0;i<iterations;i++))
 do
-	for pgm in ./lifo-push ./lifo-push-atomic ./lifo-push-atomicw ./lifo-push-int ./lifo-push-london ./lifo-push-rcu ./lifo-push-rep
+	for t in $threads
 	do
-		echo Running $pgm iteration $i
-		if time $pgm
-		then
-			:
-		else
-			echo "!!! Run failed"
-			ret=1
-		fi
+		for pgm in ./lifo-push ./lifo-push-atomic ./lifo-push-atomicw ./lifo-push-atomicw-comb ./lifo-push-bound ./lifo-push-ebr ./lifo-push-hp ./lifo-push-int ./lifo-push-lib ./lifo-push-london ./lifo-push-rcu ./lifo-push-rcu-batch ./lifo-push-rcu-qsbr ./lifo-push-rcu-qsbr-batch ./lifo-push-rep ./lifo-push-shard ./lifo-push-tag ./lifo-push-wait
+		do
+			echo Running $pgm iteration $i threads $t
+			if time $pgm -p $t -c $t -o csv "$@"
+			then
+				:
+			else
+				echo "!!! Run failed"
+				ret=1
+			fi
+		done
 	done
 done
 exit $ret
@@ -0,0 +1,79 @@
+// Adapted from lifo-push.c, adding wakeups for parked poppers.
+//
+// Pushers that make the list non-empty call list_wake(), which wakes a
+// parked popper, if any.  Detecting that transition requires the old
+// value of top, which is held in a local variable rather than reloaded
+// from the new node's ->next pointer, because a popper might already
+// have freed the new node by the time the CAS returns.  Run with -k to
+// park poppers on an empty list, or without it to compare against
+// spinning poppers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+typedef char *value_t;
+
+struct node_t {
+	value_t val;
+	struct node_t *next;
+};
+
+#include "lifo-alloc.h"
+
+void set_value(struct node_t *p, value_t v)
+{
+	p->val = v;
+}
+
+void foo(struct node_t *p);
+void list_wake(void);
+#define HAVE_LIST_WAKE
+
+// LIFO list structure
+struct node_t* _Atomic top;
+
+void list_push(value_t v)
+{
+	struct node_t *newnode = node_alloc();
+	struct node_t *old = atomic_load(&top);
+
+	set_value(newnode, v);
+	do {
+		newnode->next = old;
+	} while (!atomic_compare_exchange_weak(&top, &old, newnode));
+	if (!old)
+		list_wake();
+}
+
+// Push a private chain of nodes onto the list with a single CAS.
+void list_push_chain(struct node_t *first, struct node_t *last)
+{
+	struct node_t *old = atomic_load(&top);
+
+	do {
+		last->next = old;
+	} while (!atomic_compare_exchange_weak(&top, &old, first));
+	if (!old)
+		list_wake();
+}
+
+
+void list_pop_all()
+{
+	struct node_t *p = atomic_exchange(&top, NULL);
+
+	while (p) {
+		struct node_t *next = p->next;
+
+		foo(p);
+		node_free(p);
+		p = next;
+	}
+}
+
+#define rcu_register_thread() do { } while (0)
+#define rcu_unregister_thread() do { } while (0)
+#include "lifo-stress.h"
@@ -15,6 +15,8 @@ struct node_t {
 	struct node_t *next;
 };
 
+#include "lifo-alloc.h"
+
 void set_value(struct node_t *p, value_t v)
 {
 	p->val = v;
@@ -27,7 +29,7 @@ struct node_t* _Atomic top;
 
 void list_push(value_t v)
 {
-	struct node_t *newnode = (struct node_t *) malloc(sizeof(*newnode));
+	struct node_t *newnode = node_alloc();
 
 	set_value(newnode, v);
 	newnode->next = atomic_load(&top);
@@ -36,6 +38,15 @@ void list_push(value_t v)
 	} while (!atomic_compare_exchange_weak(&top, &newnode->next, newnode));
 }
 
+// Push a private chain of nodes onto the list with a single CAS.
+void list_push_chain(struct node_t *first, struct node_t *last)
+{
+	last->next = atomic_load(&top);
+	do {
+		// last->next may have become invalid
+	} while (!atomic_compare_exchange_weak(&top, &last->next, first));
+}
+
 
 void list_pop_all()
 {
@@ -45,7 +56,7 @@ void list_pop_all()
 		struct node_t *next = p->next;
 
 		foo(p);
-		free(p);
+		node_free(p);
 		p = next;
 	}
 }
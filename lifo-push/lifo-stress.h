@@ -10,13 +10,105 @@
 //	And, If So, What Can You Do About It?":
 //	git://git.kernel.org/pub/scm/linux/kernel/git/paulmck/perfbook.git
 
-#define N_PUSH 2
-#define N_POP  2
-#define N_ELEM (10 * 1000 * 1000L)
+#include <poll.h>
+#include <sched.h>
 
-char s[N_PUSH * N_ELEM];
+#include "hist.h"
+#include "perfctr.h"
+#include "results.h"
+#include "affinity.h"
+#include "eventcount.h"
+
+#define MAX_PUSH_BATCH 1024
+
+long n_push = 2;
+long n_pop = 2;
+long n_elem = 10 * 1000 * 1000L; // Per pusher.
+long duration; // Seconds to push in time-bounded mode, or 0 to push n_elem.
+long warmup_ms; // Time-bounded pushing excluded from measurement.
+long sample_ms = 100; // Time-bounded throughput sampling interval.
+
+char *s; // Per-element counts, n_elem per pusher.
+long *n_pushed; // Pushes by each pusher.
+
+// Running per-thread operation counts, sampled by main() in time-bounded
+// mode.  Each is written only by its own thread, and only with relaxed
+// stores to its own cache line.
+struct thread_ops {
+	unsigned long _Atomic n;
+} __attribute__((__aligned__(64)));
+struct thread_ops *push_ops; // Values pushed by each pusher.
+struct thread_ops *pop_ops;  // Elements processed by each popper.
+__thread unsigned long n_popped; // Elements processed by this thread.
+
+#define GOFLAG_INIT  0
+#define GOFLAG_RUN   1 // Pushers and poppers running.
+#define GOFLAG_DRAIN 2 // Time-bounded pushers stop, poppers keep going.
+#define GOFLAG_STOP  3 // Poppers stop.
 int _Atomic goflag;
 
+int latency; // Record per-operation latency histograms?
+struct hist push_hist;
+struct hist pop_hist;
+
+int perfctrs; // Measure hardware performance counters?
+struct perfctr_totals push_perf;
+struct perfctr_totals pop_perf;
+
+int results_fmt = RESULTS_NONE;
+int affinity = AFFINITY_NONE; // Pushers are group 0, poppers group 1.
+long push_batch = 1; // Values per list_push_n(), or 1 for list_push().
+#ifndef HAVE_LIST_BOUND
+int push_prealloc; // Push preallocated caller-owned nodes?
+char **prealloc_nodes; // Each pusher's nodes, node_size() bytes apart.
+#endif
+#ifdef HAVE_LIST_BOUND
+int push_try; // Push with list_try_push*(), retrying while full?
+#endif
+#ifdef HAVE_LIST_WAKE
+int park; // Park poppers when the list is empty instead of spinning?
+#else
+#define park 0
+#endif
+struct eventcount pop_ec; // Parked poppers.
+unsigned long _Atomic wake_ns; // nsec_now() at the most recent wakeup.
+unsigned long _Atomic n_parks;
+unsigned long _Atomic n_wakeups;
+struct hist wake_hist;
+unsigned long _Atomic pop_cpu_ns; // CPU time consumed by all poppers.
+#ifdef HAVE_LIST_POP_ONE
+long pop_singles = 16; // list_pop_one() calls per list_pop_all().
+#endif
+#ifdef HAVE_CAS_STATS
+unsigned long _Atomic cas_failures_total;
+#endif
+
+// Per-element consumer work done by foo().
+#define WORK_NONE  0
+#define WORK_SPIN  1 // Spin for work_arg iterations.
+#define WORK_TOUCH 2 // Write one byte in each of work_arg payload cache lines.
+#define WORK_HASH  3 // Hash the entire payload.
+const char *work_names[] = { "none", "spin", "touch", "hash" };
+int work = WORK_NONE;
+long work_arg;
+__thread unsigned long work_sink; // Keeps hash computations live.
+char work_desc[32];
+
+// Some RCU flavors require readers to periodically report quiescent states.
+#ifndef lifo_quiescent_state
+#define lifo_quiescent_state() do { } while (0)
+#endif
+#define QS_INTERVAL 256
+
+// Variants whose poppers hold per-thread state, such as nodes retired
+// but not yet freed, define these to set it up and release it.
+#ifndef lifo_pop_register_thread
+#define lifo_pop_register_thread() do { } while (0)
+#endif
+#ifndef lifo_pop_unregister_thread
+#define lifo_pop_unregister_thread() do { } while (0)
+#endif
+
 #ifndef list_empty
 int list_empty(struct node_t *p)
 {
@@ -24,67 +116,759 @@ int list_empty(struct node_t *p)
 }
 #endif
 
+// Variants whose links are not plain pointers define this to link a
+// node that is not yet on the list.
+#ifndef list_set_next
+#define list_set_next(p, q) ((p)->next = (q))
+#endif
+
+// Link the n values in v[] into a private chain of new nodes, with v[n - 1]
+// at the head as if pushed individually.  Returns the head of the chain
+// and sets *lastp to its last node.
+struct node_t *list_build_chain(value_t *v, long n, struct node_t **lastp)
+{
+	struct node_t *first = NULL;
+	long i;
+
+	for (i = 0; i < n; i++) {
+		struct node_t *newnode = node_alloc();
+
+		set_value(newnode, v[i]);
+		list_set_next(newnode, first);
+		if (!first)
+			*lastp = newnode;
+		first = newnode;
+	}
+	return first;
+}
+
+// Push n values with a single list_push_chain().  Variants that must do
+// more, such as waiting for room, define HAVE_LIST_PUSH_N and their own.
+#ifndef HAVE_LIST_PUSH_N
+void list_push_n(value_t *v, long n)
+{
+	struct node_t *first;
+	struct node_t *last = NULL; // Set by list_build_chain() when n > 0.
+
+	if (n <= 0)
+		return;
+	first = list_build_chain(v, n, &last);
+	list_push_chain(first, last);
+}
+#endif
+
+// Parse a -W argument of the form name[:arg], returning -1 if invalid.
+int work_parse(char *arg)
+{
+	char *cp = strchr(arg, ':');
+	int i;
+
+	if (cp)
+		*cp++ = '\0';
+	for (i = 0; i < (int)(sizeof(work_names) / sizeof(work_names[0])); i++) {
+		if (strcmp(arg, work_names[i]))
+			continue;
+		work_arg = cp ? strtol(cp, NULL, 0) : 0;
+		if (work_arg < 0 || ((i == WORK_SPIN || i == WORK_TOUCH) && !work_arg))
+			return -1;
+		return i;
+	}
+	return -1;
+}
+
+// Model real processing of each popped element, so that the balance
+// between pushers and poppers can be varied.
+void consume(struct node_t *p)
+{
+	char *cp = node_payload_ptr(p);
+	unsigned long h;
+	long i;
+
+	switch (work) {
+	case WORK_SPIN:
+		for (i = 0; i < work_arg; i++)
+			__asm__ __volatile__("" : : : "memory");
+		break;
+	case WORK_TOUCH:
+		for (i = 0; i < work_arg; i++)
+			cp[i * 64]++;
+		break;
+	case WORK_HASH:
+		// FNV-1a.
+		h = 14695981039346656037UL;
+		for (i = 0; i < node_payload; i++)
+			h = (h ^ (unsigned char)cp[i]) * 1099511628211UL;
+		work_sink += h;
+		break;
+	}
+}
+
 void foo(struct node_t *p)
 {
-	(*p->val)++;
+	if (work != WORK_NONE)
+		consume(p);
+	// In time-bounded mode, the same element can be in the list more
+	// than once, so concurrent poppers might increment it concurrently.
+	if (duration)
+		__atomic_fetch_add(p->val, 1, __ATOMIC_RELAXED);
+	else
+		(*p->val)++;
+	n_popped++;
+}
+
+// Called by list_push() and friends after making the list non-empty.
+void list_wake(void)
+{
+	if (!park || !ec_has_waiters(&pop_ec))
+		return;
+	atomic_store_explicit(&wake_ns, nsec_now(), memory_order_relaxed);
+	ec_notify(&pop_ec, 1);
+}
+
+// Park until a pusher makes the list non-empty or the test ends,
+// recording the wakeup latency in wh.
+void pop_park(struct hist *wh)
+{
+	unsigned int key = ec_prepare(&pop_ec);
+
+	if (!list_empty(top) || atomic_load(&goflag) == GOFLAG_STOP) {
+		ec_cancel(&pop_ec);
+		return;
+	}
+	atomic_fetch_add_explicit(&n_parks, 1, memory_order_relaxed);
+	if (!ec_wait(&pop_ec, key))
+		return;
+	atomic_fetch_add_explicit(&n_wakeups, 1, memory_order_relaxed);
+	hist_record(wh, nsec_now() - atomic_load_explicit(&wake_ns, memory_order_relaxed));
+}
+
+unsigned long thread_cpu_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+// With -T, a full list makes the pusher yield the CPU, as if doing other
+// work, before retrying.
+void push_one(value_t v)
+{
+#ifdef HAVE_LIST_BOUND
+	if (push_try) {
+		while (!list_try_push(v))
+			sched_yield();
+		return;
+	}
+#endif
+	list_push(v);
+}
+
+void push_many(value_t *v, long n)
+{
+#ifdef HAVE_LIST_BOUND
+	if (push_try) {
+		while (!list_try_push_n(v, n))
+			sched_yield();
+		return;
+	}
+#endif
+	list_push_n(v, n);
+}
+
+// Should pusher me push another batch, having already pushed i values?
+int push_more(long me, long i)
+{
+	if (duration) {
+		atomic_store_explicit(&push_ops[me].n, i, memory_order_relaxed);
+		return atomic_load_explicit(&goflag, memory_order_relaxed) == GOFLAG_RUN;
+	}
+	return i < n_elem;
 }
 
 void *push_em(void *arg)
 {
 	long i;
-	char *my_s = arg;
+	long me = (long)arg;
+	char *my_s = &s[n_elem * me];
+	struct hist *h = NULL;
+	unsigned long t0 = 0;
+	struct perfctr pc;
+#ifndef HAVE_LIST_BOUND
+	char *nodes = NULL;
+	long sz = node_size();
+#endif
+
+	if (latency) {
+		h = malloc(sizeof(*h));
+		if (!h) {
+			perror("malloc");
+			exit(1);
+		}
+		hist_init(h);
+	}
+	if (affinity != AFFINITY_NONE) {
+		affinity_pin(0, me);
+		// First touch from this CPU makes this memory NUMA-local.
+		memset(my_s, 0, n_elem);
+	}
+#ifndef HAVE_LIST_BOUND
+	if (push_prealloc) {
+		nodes = malloc(n_elem * sz);
+		if (!nodes) {
+			perror("malloc");
+			exit(1);
+		}
+		for (i = 0; i < n_elem; i++) {
+			struct node_t *p = (struct node_t *)(nodes + i * sz);
 
+			set_value(p, &my_s[i]);
+			node_payload_fill(p);
+		}
+		prealloc_nodes[me] = nodes;
+	}
+#endif
 	rcu_register_thread();
 	while (!atomic_load(&goflag))
 		continue;
-	for (i = 0; i < N_ELEM; i++)
-		list_push(&my_s[i]);
+	if (perfctrs)
+		perfctr_start(&pc);
+#ifndef HAVE_LIST_BOUND
+	if (push_prealloc) {
+		// The intrusive path: no allocation, just the CAS.
+		for (i = 0; push_more(me, i); i++) {
+			struct node_t *p = (struct node_t *)(nodes + i * sz);
+
+			if (h)
+				t0 = nsec_now();
+			list_push_chain(p, p);
+			if (h)
+				hist_record(h, nsec_now() - t0);
+			if (!(i % QS_INTERVAL))
+				lifo_quiescent_state();
+		}
+	} else
+#endif
+	if (push_batch == 1) {
+		for (i = 0; push_more(me, i); i++) {
+			if (h)
+				t0 = nsec_now();
+			push_one(&my_s[i % n_elem]);
+			if (h)
+				hist_record(h, nsec_now() - t0);
+			if (!(i % QS_INTERVAL))
+				lifo_quiescent_state();
+		}
+	} else {
+		value_t v[MAX_PUSH_BATCH];
+		long j;
+		long n;
+
+		for (i = 0; push_more(me, i); i += n) {
+			n = push_batch;
+			if (!duration && n_elem - i < n)
+				n = n_elem - i;
+			for (j = 0; j < n; j++)
+				v[j] = &my_s[(i + j) % n_elem];
+			if (h)
+				t0 = nsec_now();
+			push_many(v, n);
+			if (h)
+				hist_record(h, nsec_now() - t0);
+			lifo_quiescent_state();
+		}
+	}
+	if (perfctrs)
+		perfctr_stop(&pc, &push_perf);
+	n_pushed[me] = i;
+	if (h) {
+		hist_merge(&push_hist, h);
+		free(h);
+	}
+#ifdef HAVE_CAS_STATS
+	atomic_fetch_add(&cas_failures_total, cas_failures);
+#endif
 	rcu_unregister_thread();
 	return NULL;
 }
 
 void *pop_em(void *arg)
 {
+#ifdef HAVE_LIST_POP_ONE
+	long i;
+#endif
+	long me = (long)arg;
+	struct hist *h = NULL;
+	struct hist *wh = NULL;
+	unsigned long t0;
+	unsigned long cpu0;
+	struct perfctr pc;
+
+	if (affinity != AFFINITY_NONE)
+		affinity_pin(1, me);
+	if (latency)
+		h = malloc(sizeof(*h));
+	if (park)
+		wh = malloc(sizeof(*wh));
+	if ((latency && !h) || (park && !wh)) {
+		perror("malloc");
+		exit(1);
+	}
+	if (h)
+		hist_init(h);
+	if (wh)
+		hist_init(wh);
+	lifo_pop_register_thread();
 	while (!atomic_load(&goflag))
 		continue;
-	while (atomic_load(&goflag) == 1)
-		list_pop_all();
+	if (perfctrs)
+		perfctr_start(&pc);
+	cpu0 = thread_cpu_ns();
+	while (atomic_load(&goflag) < GOFLAG_STOP) {
+#ifdef HAVE_LIST_POP_ONE
+		for (i = 0; i < pop_singles; i++)
+			if (!list_pop_one())
+				break;
+#endif
+		if (park && list_empty(top)) {
+			pop_park(wh);
+			continue;
+		}
+		// Time only drains that are likely to find something.
+		if (h && !list_empty(top)) {
+			t0 = nsec_now();
+			list_pop_all();
+			hist_record(h, nsec_now() - t0);
+		} else {
+			list_pop_all();
+		}
+		if (duration)
+			atomic_store_explicit(&pop_ops[me].n, n_popped,
+					      memory_order_relaxed);
+	}
+	atomic_fetch_add(&pop_cpu_ns, thread_cpu_ns() - cpu0);
+	if (perfctrs)
+		perfctr_stop(&pc, &pop_perf);
+	lifo_pop_unregister_thread();
+	if (h) {
+		hist_merge(&pop_hist, h);
+		free(h);
+	}
+	if (wh) {
+		hist_merge(&wake_hist, wh);
+		free(wh);
+	}
 	return NULL;
 }
 
+// Snapshot the per-thread operation counts, pushers first.
+void ops_snapshot(unsigned long *v)
+{
+	long i;
+
+	for (i = 0; i < n_push; i++)
+		v[i] = atomic_load_explicit(&push_ops[i].n, memory_order_relaxed);
+	for (i = 0; i < n_pop; i++)
+		v[n_push + i] = atomic_load_explicit(&pop_ops[i].n, memory_order_relaxed);
+}
+
+// Jain's fairness index: 1 if all n threads did the same amount of
+// work, down to 1/n if one thread did all of it.
+double jain_index(unsigned long *v, long n)
+{
+	double sum = 0;
+	double sumsq = 0;
+	long i;
+
+	for (i = 0; i < n; i++) {
+		sum += v[i];
+		sumsq += (double)v[i] * v[i];
+	}
+	return sumsq > 0 ? sum * sum / (n * sumsq) : 1.;
+}
+
+// Time-bounded mode: let the threads warm up for warmup_ms, then sample
+// per-thread throughput every sample_ms for duration seconds, reporting
+// each interval along with steady-state throughput, fairness between
+// pushers and popper starvation over the window as a whole.  Only this
+// window is bracketed by results_start() and results_stop().  Returns
+// the number of values pushed within the window.
+long run_timed(char *progname, struct results *rp)
+{
+	long nthreads = n_push + n_pop;
+	unsigned long *start = calloc(nthreads, sizeof(*start));
+	unsigned long *prev = calloc(nthreads, sizeof(*prev));
+	unsigned long *cur = calloc(nthreads, sizeof(*cur));
+	unsigned long *d = calloc(nthreads, sizeof(*d));
+	long *starved = calloc(n_pop, sizeof(*starved));
+	unsigned long t_start, t_prev, t_now, t_end;
+	unsigned long *tmp;
+	unsigned long npush;
+	unsigned long npop;
+	double rate;
+	double rmin = 0;
+	double rmax = 0;
+	long nsamples = 0;
+	long nstarved;
+	long ms;
+	long i;
+
+	if (!start || !prev || !cur || !d || !starved) {
+		perror("malloc");
+		exit(1);
+	}
+	if (warmup_ms)
+		poll(NULL, 0, warmup_ms);
+	ops_snapshot(start);
+	memcpy(prev, start, nthreads * sizeof(*prev));
+	results_start(rp);
+	t_start = t_prev = nsec_now();
+	t_end = t_start + duration * 1000000000UL;
+	while ((t_now = nsec_now()) < t_end) {
+		ms = (t_end - t_now + 999999) / 1000000;
+		poll(NULL, 0, ms < sample_ms ? ms : sample_ms);
+		t_now = nsec_now();
+		ops_snapshot(cur);
+		npush = npop = 0;
+		nstarved = 0;
+		for (i = 0; i < nthreads; i++) {
+			d[i] = cur[i] - prev[i];
+			if (i < n_push) {
+				npush += d[i];
+			} else {
+				npop += d[i];
+				if (!d[i]) {
+					starved[i - n_push]++;
+					nstarved++;
+				}
+			}
+		}
+		rate = npush / ((t_now - t_prev) / 1e9);
+		if (!nsamples || rate < rmin)
+			rmin = rate;
+		if (rate > rmax)
+			rmax = rate;
+		nsamples++;
+		printf("%s sample %.3f s: push %.0f/s pop %.0f/s push-fairness %.3f starved-poppers %ld\n",
+		       progname, (t_now - t_start) / 1e9, rate,
+		       npop / ((t_now - t_prev) / 1e9),
+		       jain_index(d, n_push), nstarved);
+		tmp = prev;
+		prev = cur;
+		cur = tmp;
+		t_prev = t_now;
+	}
+	results_stop(rp);
+	atomic_store(&goflag, GOFLAG_DRAIN);
+
+	// Window totals run through the last sample, matching results_stop().
+	npush = npop = 0;
+	for (i = 0; i < nthreads; i++) {
+		d[i] = prev[i] - start[i];
+		if (i < n_push)
+			npush += d[i];
+		else
+			npop += d[i];
+	}
+	printf("%s steady state: %.0f pushes/s over %.3f s after %ld ms warm-up, samples min %.0f max %.0f\n",
+	       progname, npush / rp->wall, rp->wall, warmup_ms, rmin, rmax);
+	printf("%s push fairness %.3f, pop fairness %.3f\n",
+	       progname, jain_index(d, n_push), jain_index(&d[n_push], n_pop));
+	for (i = 0; i < n_pop; i++)
+		printf("%s popper %ld: %lu elements (%.1f%%), starved in %ld of %ld samples\n",
+		       progname, i, d[n_push + i],
+		       npop ? 100. * d[n_push + i] / npop : 0.,
+		       starved[i], nsamples);
+	free(starved);
+	free(d);
+	free(cur);
+	free(prev);
+	free(start);
+	return npush;
+}
+
+void usage(char *progname)
+{
+	fprintf(stderr, "Usage: %s [options]\n", progname);
+	fprintf(stderr, "\t-a: Thread placement: none, compact, scatter, cross-socket or smt-pair.\n");
+	fprintf(stderr, "\t-p: Number of pushers, default %ld.\n", n_push);
+	fprintf(stderr, "\t-c: Number of poppers, default %ld.\n", n_pop);
+	fprintf(stderr, "\t-n: Number of elements per pusher, default %ld.\n", n_elem);
+	fprintf(stderr, "\t-d: Push for the specified number of seconds, reusing elements.\n");
+	fprintf(stderr, "\t-w: With -d, first push for the specified number of milliseconds unmeasured.\n");
+	fprintf(stderr, "\t-i: With -d, throughput sampling interval in milliseconds, default %ld.\n",
+		sample_ms);
+	fprintf(stderr, "\t-l: Print per-push and per-drain latency percentiles.\n");
+	fprintf(stderr, "\t-o: Print a machine-readable result in the specified format (csv or json).\n");
+	fprintf(stderr, "\t-P: Print hardware performance counter metrics.\n");
+	fprintf(stderr, "\t-W: Per-element consumer work: none, spin:N iterations, touch:K cache lines\n");
+	fprintf(stderr, "\t    of payload (implying at least K lines of payload), or hash (the payload).\n");
+	fprintf(stderr, "\t-B: Bytes of payload per node, default %ld.\n", node_payload);
+#ifndef HAVE_LIST_BOUND
+	fprintf(stderr, "\t-z: Push preallocated nodes with list_push_chain(), not with -b or -d.\n");
+#endif
+	fprintf(stderr, "\t-b: Push values in batches of up to %d using list_push_n().\n",
+		MAX_PUSH_BATCH);
+#ifdef HAVE_LIST_BOUND
+	fprintf(stderr, "\t-C: List capacity, default %ld.\n", list_capacity);
+	fprintf(stderr, "\t-T: Retry list_try_push() rather than blocking when full.\n");
+#endif
+#ifdef HAVE_LIST_WAKE
+	fprintf(stderr, "\t-k: Park poppers on a futex while the list is empty.\n");
+#endif
+#ifdef HAVE_LIST_POP_ONE
+	fprintf(stderr, "\t-s: Number of list_pop_one() calls per list_pop_all(), default %ld.\n",
+		pop_singles);
+#endif
+	exit(1);
+}
+
 int main(int argc, char *argv[])
 {
+	int c;
 	long i;
-	pthread_t tid[N_PUSH + N_POP];
+	long total = 0;
+	long measured = 0;
+	pthread_t *tid;
 	void *vp;
+	struct results res;
+	char params[192];
 
-	for (i = 0; i < N_PUSH; i++)
-		if (pthread_create(&tid[i], NULL, push_em, (void *)&s[N_ELEM * i])) {
+	while ((c = getopt(argc, argv, "a:b:B:c:C:d:i:kln:o:p:Ps:Tw:W:z")) != -1) {
+		switch (c) {
+		case 'a':
+			affinity = affinity_parse(optarg);
+			if (affinity < 0)
+				usage(argv[0]);
+			break;
+		case 'i':
+			sample_ms = strtol(optarg, NULL, 0);
+			if (sample_ms < 1)
+				usage(argv[0]);
+			break;
+		case 'l':
+			latency = 1;
+			break;
+		case 'c':
+			n_pop = strtol(optarg, NULL, 0);
+			if (n_pop < 1)
+				usage(argv[0]);
+			break;
+		case 'd':
+			duration = strtol(optarg, NULL, 0);
+			if (duration < 1)
+				usage(argv[0]);
+			break;
+		case 'n':
+			n_elem = strtol(optarg, NULL, 0);
+			if (n_elem < 1)
+				usage(argv[0]);
+			break;
+		case 'o':
+			results_fmt = results_format(optarg);
+			if (results_fmt < 0)
+				usage(argv[0]);
+			break;
+		case 'p':
+			n_push = strtol(optarg, NULL, 0);
+			if (n_push < 1)
+				usage(argv[0]);
+			break;
+		case 'P':
+			perfctrs = 1;
+			break;
+		case 'w':
+			warmup_ms = strtol(optarg, NULL, 0);
+			if (warmup_ms < 0)
+				usage(argv[0]);
+			break;
+		case 'W':
+			work = work_parse(optarg);
+			if (work < 0)
+				usage(argv[0]);
+			break;
+		case 'B':
+			node_payload = strtol(optarg, NULL, 0);
+			if (node_payload < 0)
+				usage(argv[0]);
+			break;
+		case 'b':
+			push_batch = strtol(optarg, NULL, 0);
+			if (push_batch < 1 || push_batch > MAX_PUSH_BATCH)
+				usage(argv[0]);
+			break;
+#ifndef HAVE_LIST_BOUND
+		case 'z':
+			push_prealloc = 1;
+			node_caller_owned = 1;
+			break;
+#endif
+#ifdef HAVE_LIST_BOUND
+		case 'C':
+			list_set_capacity(strtol(optarg, NULL, 0));
+			if (list_capacity < 1)
+				usage(argv[0]);
+			break;
+		case 'T':
+			push_try = 1;
+			break;
+#endif
+#ifdef HAVE_LIST_WAKE
+		case 'k':
+			park = 1;
+			break;
+#endif
+#ifdef HAVE_LIST_POP_ONE
+		case 's':
+			pop_singles = strtol(optarg, NULL, 0);
+			if (pop_singles < 0)
+				usage(argv[0]);
+			break;
+#endif
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc)
+		usage(argv[0]);
+#ifndef HAVE_LIST_BOUND
+	// Each preallocated node can be pushed only once.
+	if (push_prealloc && (duration || push_batch != 1))
+		usage(argv[0]);
+#endif
+#ifdef HAVE_LIST_BOUND
+	// A batch larger than the list could never be pushed.
+	if (push_batch > list_capacity)
+		usage(argv[0]);
+#endif
+	if (work == WORK_TOUCH && node_payload < work_arg * 64)
+		node_payload = work_arg * 64;
+	if (work == WORK_SPIN || work == WORK_TOUCH)
+		snprintf(work_desc, sizeof(work_desc), "%s:%ld",
+			 work_names[work], work_arg);
+	else
+		snprintf(work_desc, sizeof(work_desc), "%s", work_names[work]);
+	affinity_init(affinity, n_push);
+	if (affinity != AFFINITY_NONE)
+		affinity_print(argv[0]);
+	hist_init(&push_hist);
+	hist_init(&pop_hist);
+	hist_init(&wake_hist);
+	perfctr_init(&push_perf);
+	perfctr_init(&pop_perf);
+	s = calloc(n_push * n_elem, sizeof(*s));
+	n_pushed = calloc(n_push, sizeof(*n_pushed));
+	push_ops = calloc(n_push, sizeof(*push_ops));
+	pop_ops = calloc(n_pop, sizeof(*pop_ops));
+	tid = malloc((n_push + n_pop) * sizeof(*tid));
+#ifndef HAVE_LIST_BOUND
+	prealloc_nodes = calloc(n_push, sizeof(*prealloc_nodes));
+	if (!prealloc_nodes) {
+		perror("malloc");
+		exit(1);
+	}
+#endif
+	if (!s || !n_pushed || !push_ops || !pop_ops || !tid) {
+		perror("malloc");
+		exit(1);
+	}
+	for (i = 0; i < n_push; i++)
+		if (pthread_create(&tid[i], NULL, push_em, (void *)i)) {
 			perror("pthread_create");
 			exit(1);
 		}
-	for (i = 0; i < N_POP; i++)
-		if (pthread_create(&tid[N_PUSH + i], NULL, pop_em, NULL)) {
+	for (i = 0; i < n_pop; i++)
+		if (pthread_create(&tid[n_push + i], NULL, pop_em, (void *)i)) {
 			perror("pthread_create");
 			exit(1);
 		}
-	atomic_store(&goflag, 1);
-	for (i = 0; i < N_PUSH; i++)
+	if (!duration)
+		results_start(&res);
+	atomic_store(&goflag, GOFLAG_RUN);
+	if (duration)
+		measured = run_timed(argv[0], &res);
+	for (i = 0; i < n_push; i++)
 		if (pthread_join(tid[i], &vp) != 0) {
 			perror("pthread_join");
 			exit(1);
 		}
 	while (!list_empty(top))
-		sleep(1);
-	atomic_store(&goflag, 2);
-	for (i = 0; i < N_POP; i++)
-		if (pthread_join(tid[N_PUSH + i], &vp) != 0) {
+		poll(NULL, 0, 1);
+	atomic_store(&goflag, GOFLAG_STOP);
+	if (park)
+		ec_notify(&pop_ec, INT_MAX);
+	for (i = 0; i < n_pop; i++)
+		if (pthread_join(tid[n_push + i], &vp) != 0) {
 			perror("pthread_join");
 			exit(1);
 		}
-	for (i = 0; i < N_PUSH * N_ELEM; i++)
-		if (s[i] != 1) {
+	if (!duration)
+		results_stop(&res);
+
+	// Element j of pusher k must have been popped once for each push.
+	for (i = 0; i < n_push * n_elem; i++) {
+		long np = n_pushed[i / n_elem];
+		long j = i % n_elem;
+		unsigned char expected = np / n_elem + (j < np % n_elem);
+
+		if ((unsigned char)s[i] != expected) {
 			fprintf(stderr, "Entry %ld left set\n", i);
 			abort();
 		}
+	}
+	for (i = 0; i < n_push; i++)
+		total += n_pushed[i];
+	if (duration)
+		printf("Pushed %ld elements in all, %ld in the measured window\n",
+		       total, measured);
+	else
+		measured = total;
+	snprintf(params, sizeof(params),
+		 "p=%ld;c=%ld;n=%ld;b=%ld;d=%ld;w=%ld;a=%s;W=%s;B=%ld;k=%d",
+		 n_push, n_pop, n_elem, push_batch, duration, warmup_ms,
+		 affinity_names[affinity], work_desc, node_payload, park);
+#ifndef HAVE_LIST_BOUND
+	snprintf(params + strlen(params), sizeof(params) - strlen(params),
+		 ";z=%d", push_prealloc);
+#endif
+#ifdef HAVE_LIST_BOUND
+	snprintf(params + strlen(params), sizeof(params) - strlen(params),
+		 ";C=%ld;T=%d", list_capacity, push_try);
+#endif
+	results_print(results_fmt, argv[0], params, n_push + n_pop, measured, &res);
+	if (latency) {
+		hist_print(&push_hist, argv[0], push_batch == 1 ? "push" : "push_n");
+		hist_print(&pop_hist, argv[0], "drain");
+	}
+	printf("%s CPU per element: poppers %.1f ns, all threads %.1f ns\n",
+	       argv[0], (double)atomic_load(&pop_cpu_ns) / total,
+	       1e9 * (res.user + res.sys) / measured);
+	if (park) {
+		printf("%s parks %lu, wakeups %lu\n", argv[0],
+		       atomic_load(&n_parks), atomic_load(&n_wakeups));
+		hist_print(&wake_hist, argv[0], "wakeup");
+	}
+	if (perfctrs) {
+		perfctr_print(&push_perf, argv[0], "push", total);
+		perfctr_print(&pop_perf, argv[0], "pop", total);
+	}
+#ifdef HAVE_LIST_STATS
+	list_stats();
+#endif
+#ifdef HAVE_CAS_STATS
+	printf("CAS failures: %lu (%.4f per element)\n",
+	       atomic_load(&cas_failures_total),
+	       (double)atomic_load(&cas_failures_total) / total);
+#endif
+	free(tid);
+#ifndef HAVE_LIST_BOUND
+	for (i = 0; i < n_push; i++)
+		free(prealloc_nodes[i]);
+	free(prealloc_nodes);
+#endif
+	free(pop_ops);
+	free(push_ops);
+	free(n_pushed);
+	free(s);
+	return 0;
 }
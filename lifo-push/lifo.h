@@ -0,0 +1,179 @@
+////////////////////////////////////////////////////////////////////////
+//
+// Header-only typed LIFO lists, generalizing the lifo-push variants.
+//
+// LIFO_DEFINE(name, T, link, mo, reclaim) defines struct name, whose
+// elements are of caller-defined type T containing a "T *link" field,
+// so that nodes are intrusive and pushing allocates nothing.  It also
+// defines the following functions:
+//
+//	name_push(l, p):	Push node p.
+//	name_push_chain(l, first, last):
+//				Push a private chain of nodes linked
+//				through their link fields with one CAS.
+//	name_pop_all(l):	Detach and return the whole list, most
+//				recently pushed node first.
+//	name_next(p):		The node after p in a detached list.
+//	name_drain(l, fn):	Detach the whole list, then call fn on each
+//				node and hand it to the reclamation policy.
+//	name_empty(l):		Is the list empty?
+//
+// The mo argument selects the memory-order policy:
+//
+//	seq_cst:	Sequentially consistent, as in lifo-push.c.
+//	acq_rel:	Release pushes and acquire pops, which suffice to
+//			publish node contents, as in lifo-push-atomicw.c.
+//	relaxed:	Relaxed wherever legal: pushes must still be release
+//			to publish node contents, but pops are relaxed,
+//			followed by an acquire fence only if they found
+//			something, so that empty pops are unordered.
+//
+// The reclaim argument selects what name_drain() does with each node
+// after fn returns:
+//
+//	none:	Nothing, because the caller owns the nodes.
+//	free:	Pass the node to free().
+//	ebr:	Pass the node to ebr_retire() from ../common/ebr.h, which
+//		must already be included.  This policy also defines
+//		name_pop_one(l), which pops a single node within an EBR
+//		read-side critical section.  EBR prevents the popped node
+//		from being reused while another pop_one() might still hold
+//		a pointer to it, which would otherwise permit ABA.  Popped
+//		nodes must therefore be retired, never pushed again.
+//
+// Push and pop-all need no reclamation policy of their own, because
+// pop-all detaches the list with a single exchange, after which the
+// popper has exclusive ownership of every node.
+//
+// LIFO_DEFINE_BOXED(name, V, mo, reclaim) instead defines a list of
+// values of type V, boxed in malloc()ed nodes of type struct name_node,
+// with name_push_value(l, v) in place of name_push().  The nodes are
+// passed to the reclamation policy, so reclaim should not be "none".
+//
+// The mo and reclaim arguments may themselves be macros, for example,
+// to allow the memory-order policy to be chosen at build time.
+//
+// The generated functions are static inline, so the same list may be
+// defined in more than one translation unit.
+//
+// See lifo.hpp for the C++ equivalent.
+
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#define LIFO_MO_PUSH_seq_cst	memory_order_seq_cst
+#define LIFO_MO_POP_seq_cst	memory_order_seq_cst
+#define LIFO_MO_LOAD_seq_cst	memory_order_seq_cst
+#define LIFO_MO_PUSH_acq_rel	memory_order_release
+#define LIFO_MO_POP_acq_rel	memory_order_acquire
+#define LIFO_MO_LOAD_acq_rel	memory_order_relaxed
+#define LIFO_MO_PUSH_relaxed	memory_order_release
+#define LIFO_MO_POP_relaxed	memory_order_relaxed
+#define LIFO_MO_LOAD_relaxed	memory_order_relaxed
+
+// Ordering needed after a pop finds a node, beyond that of the pop itself.
+#define LIFO_MO_FENCE_seq_cst()	do { } while (0)
+#define LIFO_MO_FENCE_acq_rel()	do { } while (0)
+#define LIFO_MO_FENCE_relaxed()	atomic_thread_fence(memory_order_acquire)
+
+#define LIFO_RECLAIM_none(p)	do { } while (0)
+#define LIFO_RECLAIM_free(p)	free(p)
+#define LIFO_RECLAIM_ebr(p)	ebr_retire((p), free)
+
+#define LIFO_POP_ONE_none(name, T, link, mo)
+#define LIFO_POP_ONE_free(name, T, link, mo)
+#define LIFO_POP_ONE_ebr(name, T, link, mo)				\
+static inline T *name##_pop_one(struct name *l)				\
+{									\
+	T *p;								\
+									\
+	ebr_read_lock();						\
+	p = atomic_load_explicit(&l->top, LIFO_MO_POP_##mo);		\
+	while (p) {							\
+		LIFO_MO_FENCE_##mo();					\
+		if (atomic_compare_exchange_weak_explicit(&l->top, &p,	\
+				__atomic_load_n(&p->link, __ATOMIC_RELAXED),\
+				LIFO_MO_POP_##mo, LIFO_MO_POP_##mo))	\
+			break;						\
+	}								\
+	ebr_read_unlock();						\
+	return p;							\
+}
+
+#define LIFO_DEFINE(name, T, link, mo, reclaim)				\
+	LIFO_DEFINE_(name, T, link, mo, reclaim)
+
+#define LIFO_DEFINE_(name, T, link, mo, reclaim)			\
+struct name {								\
+	T *_Atomic top;							\
+};									\
+									\
+static inline void name##_push_chain(struct name *l, T *first, T *last)	\
+{									\
+	T *old = atomic_load_explicit(&l->top, LIFO_MO_LOAD_##mo);	\
+									\
+	do {								\
+		last->link = old;					\
+	} while (!atomic_compare_exchange_weak_explicit(&l->top, &old,	\
+			first, LIFO_MO_PUSH_##mo, memory_order_relaxed));\
+}									\
+									\
+static inline void name##_push(struct name *l, T *p)			\
+{									\
+	name##_push_chain(l, p, p);					\
+}									\
+									\
+static inline T *name##_pop_all(struct name *l)				\
+{									\
+	T *p = atomic_exchange_explicit(&l->top, NULL, LIFO_MO_POP_##mo);\
+									\
+	if (p)								\
+		LIFO_MO_FENCE_##mo();					\
+	return p;							\
+}									\
+									\
+static inline T *name##_next(T *p)					\
+{									\
+	return p->link;							\
+}									\
+									\
+static inline void name##_drain(struct name *l, void (*fn)(T *p))	\
+{									\
+	T *p = name##_pop_all(l);					\
+									\
+	while (p) {							\
+		T *next = p->link;					\
+									\
+		fn(p);							\
+		LIFO_RECLAIM_##reclaim(p);				\
+		p = next;						\
+	}								\
+}									\
+									\
+static inline int name##_empty(struct name *l)				\
+{									\
+	return !atomic_load_explicit(&l->top, memory_order_relaxed);	\
+}									\
+									\
+LIFO_POP_ONE_##reclaim(name, T, link, mo)
+
+#define LIFO_DEFINE_BOXED(name, V, mo, reclaim)				\
+	LIFO_DEFINE_BOXED_(name, V, mo, reclaim)
+
+#define LIFO_DEFINE_BOXED_(name, V, mo, reclaim)			\
+struct name##_node {							\
+	V val;								\
+	struct name##_node *next;					\
+};									\
+									\
+LIFO_DEFINE(name, struct name##_node, next, mo, reclaim)		\
+									\
+static inline void name##_push_value(struct name *l, V v)		\
+{									\
+	struct name##_node *p = malloc(sizeof(*p));			\
+									\
+	if (!p)								\
+		abort();						\
+	p->val = v;							\
+	name##_push(l, p);						\
+}
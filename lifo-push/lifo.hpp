@@ -0,0 +1,127 @@
+////////////////////////////////////////////////////////////////////////
+//
+// Header-only typed LIFO lists for C++, the equivalent of lifo.h.
+//
+// lifo<T, &T::link, Reclaim, MO> is a list of intrusive nodes of type T
+// containing a "T *link" field, so pushing allocates nothing.  Its
+// members are push(), push_chain(), pop_all(), next(), drain() and
+// empty(), as described in lifo.h.  MO is lifo_seq_cst, lifo_acq_rel
+// or lifo_relaxed, and Reclaim is lifo_reclaim_none or
+// lifo_reclaim_delete, which is applied to each node after drain()
+// calls its function on that node.
+// There is no EBR policy because ../common/ebr.h is C-only.
+//
+// boxed_lifo<V, MO> is a list of values of type V, boxed in nodes
+// allocated by push() and deleted by drain().
+
+#include <atomic>
+
+struct lifo_seq_cst {
+	static constexpr std::memory_order push = std::memory_order_seq_cst;
+	static constexpr std::memory_order pop = std::memory_order_seq_cst;
+	static constexpr std::memory_order load = std::memory_order_seq_cst;
+	static constexpr bool fence = false;
+};
+
+struct lifo_acq_rel {
+	static constexpr std::memory_order push = std::memory_order_release;
+	static constexpr std::memory_order pop = std::memory_order_acquire;
+	static constexpr std::memory_order load = std::memory_order_relaxed;
+	static constexpr bool fence = false;
+};
+
+// Pops are relaxed, with an acquire fence only if they found something.
+struct lifo_relaxed {
+	static constexpr std::memory_order push = std::memory_order_release;
+	static constexpr std::memory_order pop = std::memory_order_relaxed;
+	static constexpr std::memory_order load = std::memory_order_relaxed;
+	static constexpr bool fence = true;
+};
+
+struct lifo_reclaim_none {
+	template <typename T> static void reclaim(T *) { }
+};
+
+struct lifo_reclaim_delete {
+	template <typename T> static void reclaim(T *p) { delete p; }
+};
+
+template <typename T, T *T::*Link, typename Reclaim = lifo_reclaim_none,
+	  typename MO = lifo_seq_cst>
+class lifo {
+	std::atomic<T *> top{nullptr};
+
+public:
+	// Push a private chain of nodes with a single CAS.
+	void push_chain(T *first, T *last)
+	{
+		T *old = top.load(MO::load);
+
+		do {
+			last->*Link = old;
+		} while (!top.compare_exchange_weak(old, first, MO::push,
+						    std::memory_order_relaxed));
+	}
+
+	void push(T *p)
+	{
+		push_chain(p, p);
+	}
+
+	T *pop_all()
+	{
+		T *p = top.exchange(nullptr, MO::pop);
+
+		if (MO::fence && p)
+			std::atomic_thread_fence(std::memory_order_acquire);
+		return p;
+	}
+
+	static T *next(T *p)
+	{
+		return p->*Link;
+	}
+
+	template <typename F> void drain(F fn)
+	{
+		T *p = pop_all();
+
+		while (p) {
+			T *nextp = p->*Link;
+
+			fn(p);
+			Reclaim::reclaim(p);
+			p = nextp;
+		}
+	}
+
+	bool empty() const
+	{
+		return !top.load(std::memory_order_relaxed);
+	}
+};
+
+template <typename V> struct boxed_lifo_node {
+	V val;
+	boxed_lifo_node *next;
+};
+
+template <typename V, typename MO = lifo_seq_cst>
+class boxed_lifo : public lifo<boxed_lifo_node<V>, &boxed_lifo_node<V>::next,
+			       lifo_reclaim_delete, MO> {
+public:
+	using node = boxed_lifo_node<V>;
+
+	void push(const V &v)
+	{
+		node *p = new node{v, nullptr};
+
+		this->push_chain(p, p);
+	}
+
+	template <typename F> void drain(F fn)
+	{
+		lifo<node, &node::next, lifo_reclaim_delete, MO>::drain(
+			[&fn](node *p) { fn(p->val); });
+	}
+};
@@ -2,13 +2,26 @@
 // Authors: Paul E. McKenney, IBM Linux Technology Center
 //
 // Simplified beyond belief:
-// - Hash functions trivial beyond belief.
+// - Integer keys only, although the hash policies are real.
 
 #define ACCESS_ONCE(x) (*(volatile typeof(x) *)&(x))
 #define READ_ONCE(x) ({ typeof(x) ___x = ACCESS_ONCE(x); ___x; })
 #define WRITE_ONCE(x, val) do { ACCESS_ONCE(x) = (val); } while (0)
 
-#define N_LOCK_SHARDS 16384
+// Publish a pointer to an initialized structure, and pick one up.
+#define STORE_RELEASE(x, val) \
+do { \
+	atomic_thread_fence(memory_order_release); \
+	WRITE_ONCE(x, val); \
+} while (0)
+#define LOAD_ACQUIRE(x) \
+({ \
+	typeof(x) ___x = READ_ONCE(x); \
+	atomic_thread_fence(memory_order_acquire); \
+	___x; \
+})
+
+#define N_LOCK_SHARDS 16384 // Must be a power of two.
 pthread_mutex_t shard_lock[N_LOCK_SHARDS];
 
 void init_shardlock(void)
@@ -19,16 +32,81 @@ void init_shardlock(void)
 		pthread_mutex_init(&shard_lock[i], NULL);
 }
 
+// Hash policies, selected by name with hash_policy_set() before any
+// table or lock is used.  Each maps a key to a 64-bit value whose low
+// bits are well mixed, so that callers can mask them to a power-of-two
+// table size, which online resizing relies on.  The policies are:
+//
+//	modulo:		The key itself, so that masking is "key % size",
+//			which is what this code originally did.
+//	fibonacci:	Multiplication by 2^64 divided by the golden ratio,
+//			keeping the well-mixed high half of the product.
+//	murmur:		The MurmurHash3 64-bit finalizer.
+//	wyhash:		wyhash's 128-bit multiply-and-fold mixer, applied
+//			to the key itself, because names here are integers
+//			rather than strings.
+uint64_t hash_modulo(uint64_t k)
+{
+	return k;
+}
+
+uint64_t hash_fibonacci(uint64_t k)
+{
+	return (k * 0x9e3779b97f4a7c15ULL) >> 32;
+}
+
+uint64_t hash_murmur(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+uint64_t hash_wyhash(uint64_t k)
+{
+	__uint128_t r = (__uint128_t)(k ^ 0xa0761d6478bd642fULL) *
+			(k ^ 0xe7037ed1a0b428dbULL);
+
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+const char *hash_policy_names[] = { "modulo", "fibonacci", "murmur", "wyhash", };
+uint64_t (*hash_policy_fns[])(uint64_t) = {
+	hash_modulo, hash_fibonacci, hash_murmur, hash_wyhash,
+};
+int hash_policy = 2;
+uint64_t (*hash_fn)(uint64_t) = hash_murmur;
+
+// Select a policy by name, returning -1 if invalid.
+int hash_policy_set(const char *name)
+{
+	int i;
+
+	for (i = 0; i < (int)(sizeof(hash_policy_names) / sizeof(hash_policy_names[0])); i++) {
+		if (!strcmp(name, hash_policy_names[i])) {
+			hash_policy = i;
+			hash_fn = hash_policy_fns[i];
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Pointers are at least eight-byte aligned, so discard the low bits.
 int hash_lock(void *p)
 {
 	uintptr_t up = (uintptr_t) p;
 
-	return (up / sizeof(up / sizeof(p))) % N_LOCK_SHARDS;
+	return hash_fn(up >> 3) & (N_LOCK_SHARDS - 1);
 }
 
-int parthash(int i)
+// The number of buckets must be a power of two.
+int parthash(int i, long nbuckets)
 {
-	return i % N_HASH;
+	return hash_fn((unsigned int)i) & (nbuckets - 1);
 }
 
 void acquire_lock(void *p)
@@ -73,3 +151,44 @@ void release_lock_pair(void *p1, void *p2)
 		assert(!pthread_mutex_unlock(&shard_lock[i1]));
 	}
 }
+
+// Sort the shard indexes of three pointers, so that they can be
+// acquired in order and duplicates skipped.
+void lock_triple_sort(int *i, void *p1, void *p2, void *p3)
+{
+	int j;
+	int k;
+	int tmp;
+
+	i[0] = hash_lock(p1);
+	i[1] = hash_lock(p2);
+	i[2] = hash_lock(p3);
+	for (j = 1; j < 3; j++)
+		for (k = j; k > 0 && i[k - 1] > i[k]; k--) {
+			tmp = i[k];
+			i[k] = i[k - 1];
+			i[k - 1] = tmp;
+		}
+}
+
+void acquire_lock_triple(void *p1, void *p2, void *p3)
+{
+	int i[3];
+	int j;
+
+	lock_triple_sort(i, p1, p2, p3);
+	for (j = 0; j < 3; j++)
+		if (!j || i[j] != i[j - 1])
+			assert(!pthread_mutex_lock(&shard_lock[i[j]]));
+}
+
+void release_lock_triple(void *p1, void *p2, void *p3)
+{
+	int i[3];
+	int j;
+
+	lock_triple_sort(i, p1, p2, p3);
+	for (j = 0; j < 3; j++)
+		if (!j || i[j] != i[j - 1])
+			assert(!pthread_mutex_unlock(&shard_lock[i[j]]));
+}
@@ -3,9 +3,10 @@
 //      Adapted from pseudocode in WG14 N2369.
 //
 // Simplified beyond belief:
-// - Only one item in each hash bucket, which matches well-tuned common case.
-// - Integer name and ID to trivialize hash functions.
-// - Hash functions trivial even given integer trivialization.
+// - Hash tables that only ever grow, with collisions resolved by chaining.
+// - Integer name and ID, hashed by the policy selected by -H (modulo,
+//   fibonacci, murmur or wyhash, see shard-lock.h) and masked to the
+//   tables' power-of-two sizes.
 // - Parts added to hash tables one at a time:  Removal from all tables
 //   is atomic, but addition is sequential.  Pathetic rationale: Names
 //   might be assigned by Marketing late in the game.
@@ -14,13 +15,92 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <string.h>
 #include <poll.h>
 #include <assert.h>
 #include <stdatomic.h>
 #include <pthread.h>
 
-#define N_HASH /* (1024 * 1024) */ 256
+#ifndef N_HASH
+#define N_HASH 4096 // Initial table size, which must be a power of two.
+#endif
+#if N_HASH & (N_HASH - 1)
+#error "N_HASH must be a power of two"
+#endif
 #include "shard-lock.h"
+#include "perfctr.h"
+#include "results.h"
+#include "affinity.h"
+#include "hist.h"
+
+// Building with -DUSE_EBR defers freeing of deleted parts until no
+// lookup or deletion can still be referencing them.
+#ifdef USE_EBR
+#include "ebr.h"
+#define part_read_lock() ebr_read_lock()
+#define part_read_unlock() ebr_read_unlock()
+#define part_free(p) ebr_retire((p), free)
+#define part_register_thread() ebr_register_thread()
+#define part_unregister_thread() ebr_unregister_thread()
+#else /* #ifdef USE_EBR */
+#define part_read_lock() do { } while (0)
+#define part_read_unlock() do { } while (0)
+#define part_free(p) free(p)
+#define part_register_thread() do { } while (0)
+#define part_unregister_thread() do { } while (0)
+#endif /* #else #ifdef USE_EBR */
+
+// Building with -DUSE_SEQLOCK (which requires -DUSE_EBR) adds an
+// optimistic lookup path that copies the part without acquiring its
+// lock, then uses the part's sequence counter to check that no deletion
+// overlapped the copy.  Lookups thus write no shared cache lines unless
+// they must retry, which they do under the lock.  EBR keeps the part
+// from being freed while it is being copied.  Parts are initialized
+// before insertion and are otherwise modified only while locked, and
+// every such modification must be bracketed by part_write_begin() and
+// part_write_end().  The exception is the hash-chain links, whose
+// values in the copies made by lookups are meaningless anyway.
+#ifdef USE_SEQLOCK
+#ifndef USE_EBR
+#error "USE_SEQLOCK requires USE_EBR"
+#endif
+#define part_write_begin(p) \
+do { \
+	WRITE_ONCE((p)->seq, (p)->seq + 1); \
+	atomic_thread_fence(memory_order_release); \
+} while (0)
+#define part_write_end(p) \
+do { \
+	atomic_thread_fence(memory_order_release); \
+	WRITE_ONCE((p)->seq, (p)->seq + 1); \
+} while (0)
+#else /* #ifdef USE_SEQLOCK */
+#define part_write_begin(p) do { } while (0)
+#define part_write_end(p) do { } while (0)
+#endif /* #else #ifdef USE_SEQLOCK */
+
+// Building with -DUSE_RCU_LOOKUP (which also requires -DUSE_EBR) makes
+// lookups lock-free, using EBR as the RCU implementation: a lookup is
+// a load of the bucket and a copy of the part within a read-side
+// critical section, and deletion defers the free past all such
+// lookups.  This relies on parts being immutable while in the tables,
+// apart from their hash-chain links.
+#ifdef USE_RCU_LOOKUP
+#ifndef USE_EBR
+#error "USE_RCU_LOOKUP requires USE_EBR"
+#endif
+#ifdef USE_SEQLOCK
+#error "USE_RCU_LOOKUP and USE_SEQLOCK are alternatives"
+#endif
+#endif /* #ifdef USE_RCU_LOOKUP */
+
+// Lockless lookups need inserts to order the initialization of a part
+// before the store that makes it reachable.
+#if defined(USE_SEQLOCK) || defined(USE_RCU_LOOKUP)
+#define part_assign_pointer(x, p) STORE_RELEASE(x, p)
+#else
+#define part_assign_pointer(x, p) WRITE_ONCE(x, p)
+#endif
 
 // Parts keyed by name and by ID.
 struct part {
@@ -30,134 +110,492 @@ struct part {
 	int namestate; // 0=out, 1=in
 	int idstate; // 0=out, 1=in
 	struct part *statp; // Pointer to statically allocated shadow
+	unsigned int seq; // Odd while being modified, see USE_SEQLOCK.
+	struct part *next[2]; // Hash-chain links, indexed by PT_ID or PT_NAME.
 };
 
-struct part *nametab[N_HASH];
-struct part *idtab[N_HASH];
+// Each table is an array of hash chains.  A chain may be modified only
+// while holding the shard lock for the address of its bucket, and also
+// that of any part being inserted or deleted, so that removal from both
+// tables stays atomic.  Unlinking a part leaves its own link intact, so
+// that lockless lookups already traversing it can continue.
+//
+// The tables start with N_HASH buckets and double online.  While a table
+// is being resized, ->next points to its replacement, and each operation
+// that modifies the table migrates a few of its buckets there under the
+// shard locks, leaving PART_MOVED behind in each old bucket.  Exactly one
+// bucket for any given key is therefore not PART_MOVED, and whoever holds
+// its lock owns that key's chain.  Migrating a bucket splits its chain
+// between two new buckets by relinking the parts in their existing order,
+// which can make a concurrent lockless lookup skip parts, so such lookups
+// retry any miss that overlapped a migration.  The last migration installs
+// the new table and retires the old one, and because tables are reached
+// only within a read-side critical section, all operations use one.
+#define PT_ID 0
+#define PT_NAME 1
+
+#define PART_MOVED ((struct part *)1)
+#define RESIZE_CHUNK 16 // Buckets migrated by each modifying operation.
+#define RESIZE_MAX_BUCKETS (1L << 28)
 
-// Delete from all tables, return pointer to part or NULL if not present
-struct part *delete_by_id(int id)
+struct ptab {
+	long n; // Number of buckets.
+	struct ptab *next; // Replacement table while resizing.
+	struct ptab *retired; // Next retired table, without USE_EBR.
+	long _Atomic claimed; // Buckets claimed for migration.
+	long _Atomic migrated; // Buckets whose migration has completed.
+	struct part *bkt[];
+};
+
+struct ptab *parttab[2]; // Current tables, indexed by PT_ID or PT_NAME.
+unsigned long _Atomic mig_started[2]; // Bucket migrations started.
+unsigned long _Atomic mig_finished[2]; // Bucket migrations finished.
+int resize_maxload; // Parts per bucket at which a table grows, 0 for never.
+long _Atomic part_count[2]; // Approximate number of parts in each table.
+__thread long part_count_delta[2]; // Not yet added to part_count[].
+#define PART_COUNT_BATCH 64
+unsigned long _Atomic n_resizes;
+
+// Without EBR, there is no telling when the last reference to a retired
+// table goes away, so they are kept until part_tables_free().
+#ifdef USE_EBR
+#define ptab_retire(tab) ebr_retire((tab), free)
+#else /* #ifdef USE_EBR */
+struct ptab *retired_tabs;
+pthread_mutex_t retired_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void ptab_retire(struct ptab *tab)
 {
-	int idhash = parthash(id);
-	int namehash;
-	struct part *partp = READ_ONCE(idtab[idhash]);
+	pthread_mutex_lock(&retired_lock);
+	tab->retired = retired_tabs;
+	retired_tabs = tab;
+	pthread_mutex_unlock(&retired_lock);
+}
+#endif /* #else #ifdef USE_EBR */
 
-	if (!partp)
-		return NULL;
-	acquire_lock(partp);
-	if (READ_ONCE(idtab[idhash]) == partp && partp->id == id) {
-		namehash = parthash(partp->name);
-		if (nametab[namehash] == partp)
-			WRITE_ONCE(nametab[namehash], NULL);
-		WRITE_ONCE(idtab[idhash], NULL);
-		release_lock(partp);
-	} else {
-		release_lock(partp);
-		partp = NULL;
+struct ptab *ptab_alloc(long n)
+{
+	struct ptab *tab = calloc(1, sizeof(*tab) + n * sizeof(tab->bkt[0]));
+
+	if (!tab) {
+		perror("calloc");
+		exit(1);
+	}
+	tab->n = n;
+	return tab;
+}
+
+void part_tables_init(void)
+{
+	parttab[PT_ID] = ptab_alloc(N_HASH);
+	parttab[PT_NAME] = ptab_alloc(N_HASH);
+	atomic_store(&part_count[PT_ID], 0);
+	atomic_store(&part_count[PT_NAME], 0);
+}
+
+// Free the tables, which must be empty, once all other threads are done.
+void part_tables_free(void)
+{
+	int t;
+
+	for (t = 0; t < 2; t++) {
+		free(parttab[t]->next);
+		free(parttab[t]);
+	}
+#ifndef USE_EBR
+	while (retired_tabs) {
+		struct ptab *tab = retired_tabs;
+
+		retired_tabs = tab->retired;
+		free(tab);
+	}
+#endif /* #ifndef USE_EBR */
+}
+
+int part_key(struct part *partp, int t)
+{
+	return t == PT_ID ? partp->id : partp->name;
+}
+
+// Return the bucket for key in table t, following any resizes.  Unless
+// the caller holds that bucket's lock, it might become PART_MOVED at any
+// time, so the caller must recheck it after acquiring the lock.
+struct part **part_bucket(int t, int key)
+{
+	struct ptab *tab = LOAD_ACQUIRE(parttab[t]);
+	struct part **bkt = &tab->bkt[parthash(key, tab->n)];
+
+	while (LOAD_ACQUIRE(*bkt) == PART_MOVED) {
+		tab = LOAD_ACQUIRE(tab->next);
+		bkt = &tab->bkt[parthash(key, tab->n)];
+	}
+	return bkt;
+}
+
+// Return the bucket for key in table t, locked.
+struct part **part_lock_bucket(int t, int key)
+{
+	struct part **bkt;
+
+	for (;;) {
+		bkt = part_bucket(t, key);
+		acquire_lock(bkt);
+		if (*bkt != PART_MOVED)
+			return bkt;
+		release_lock(bkt);
 	}
+}
+
+// Return the part with the specified key in the chain headed by bkt,
+// or NULL if there is none.  The caller must hold the bucket's lock.
+struct part *part_find(struct part **bkt, int t, int key)
+{
+	struct part *partp;
+
+	for (partp = *bkt; partp; partp = partp->next[t])
+		if (part_key(partp, t) == key)
+			break;
 	return partp;
 }
 
+// As part_find(), but within a read-side critical section instead of
+// under the bucket's lock, for USE_SEQLOCK and USE_RCU_LOOKUP.  A miss
+// counts only if no bucket migration overlapped the traversal.
+struct part *part_find_lockless(int t, int key)
+{
+	unsigned long finished;
+	struct part *partp;
+
+	for (;;) {
+		finished = atomic_load_explicit(&mig_finished[t],
+						memory_order_acquire);
+		// The bucket can be migrated after part_bucket() checks it,
+		// so recheck for PART_MOVED, which is never in a chain.
+		partp = LOAD_ACQUIRE(*part_bucket(t, key));
+		if (partp == PART_MOVED)
+			continue;
+		for (; partp; partp = LOAD_ACQUIRE(partp->next[t]))
+			if (part_key(partp, t) == key)
+				return partp;
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&mig_started[t],
+					 memory_order_relaxed) == finished)
+			return NULL;
+	}
+}
+
+// Unlink the specified part from the chain headed by bkt, returning true
+// if it was present.
+int part_unlink(struct part **bkt, int t, struct part *partp)
+{
+	struct part **pp;
+
+	for (pp = bkt; *pp; pp = &(*pp)->next[t]) {
+		if (*pp == partp) {
+			WRITE_ONCE(*pp, partp->next[t]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Migrate bucket i of table t's current table tab to its replacement,
+// splitting the chain between new buckets i and i + tab->n.
+void part_migrate(int t, struct ptab *tab, long i)
+{
+	struct ptab *nt = tab->next;
+	struct part **obkt = &tab->bkt[i];
+	struct part **tail[2] = { &nt->bkt[i], &nt->bkt[i + tab->n] };
+	struct part *partp;
+	struct part *nextp;
+	int h;
+
+	acquire_lock_triple(obkt, tail[0], tail[1]);
+	atomic_fetch_add(&mig_started[t], 1);
+	atomic_thread_fence(memory_order_release);
+	for (partp = *obkt; partp; partp = nextp) {
+		nextp = partp->next[t];
+		h = parthash(part_key(partp, t), nt->n) != i;
+		WRITE_ONCE(*tail[h], partp);
+		tail[h] = &partp->next[t];
+	}
+	WRITE_ONCE(*tail[0], NULL);
+	WRITE_ONCE(*tail[1], NULL);
+	STORE_RELEASE(*obkt, PART_MOVED);
+	atomic_fetch_add_explicit(&mig_finished[t], 1, memory_order_release);
+	release_lock_triple(obkt, &nt->bkt[i], &nt->bkt[i + tab->n]);
+}
+
+// Start doubling table t, unless it is already being resized.
+void part_resize_start(int t)
+{
+	struct ptab *tab = LOAD_ACQUIRE(parttab[t]);
+	struct ptab *expected = NULL;
+	struct ptab *nt;
+
+	if (READ_ONCE(tab->next) || tab->n >= RESIZE_MAX_BUCKETS)
+		return;
+	nt = ptab_alloc(2 * tab->n);
+	if (!__atomic_compare_exchange_n(&tab->next, &expected, nt, 0,
+					 __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		free(nt);
+}
+
+// Account for d parts added to table t, starting a resize if that takes
+// it past resize_maxload.  Each thread batches its updates to avoid
+// contending for part_count[], so the count is approximate, and must be
+// within a read-side critical section.
+void part_count_add(int t, long d)
+{
+	long c;
+
+	part_count_delta[t] += d;
+	if (part_count_delta[t] < PART_COUNT_BATCH &&
+	    part_count_delta[t] > -PART_COUNT_BATCH)
+		return;
+	c = atomic_fetch_add(&part_count[t], part_count_delta[t]) +
+	    part_count_delta[t];
+	part_count_delta[t] = 0;
+	if (resize_maxload && c > resize_maxload * LOAD_ACQUIRE(parttab[t])->n)
+		part_resize_start(t);
+}
+
+// If table t is being resized, migrate a few of its buckets, and if that
+// completes the resize, install the new table.  The caller must be within
+// a read-side critical section and must not hold any shard locks.
+void part_resize_help(int t)
+{
+	struct ptab *tab = LOAD_ACQUIRE(parttab[t]);
+	long i;
+	int k;
+
+	if (!LOAD_ACQUIRE(tab->next))
+		return;
+	for (k = 0; k < RESIZE_CHUNK; k++) {
+		i = atomic_fetch_add(&tab->claimed, 1);
+		if (i >= tab->n)
+			return;
+		part_migrate(t, tab, i);
+		if (atomic_fetch_add(&tab->migrated, 1) + 1 == tab->n) {
+			STORE_RELEASE(parttab[t], tab->next);
+			ptab_retire(tab);
+			atomic_fetch_add(&n_resizes, 1);
+			return;
+		}
+	}
+}
+
+// Complete any resize in progress, once all other threads are done.
+void part_resize_finish(void)
+{
+	int t;
+
+	part_read_lock();
+	for (t = 0; t < 2; t++)
+		while (LOAD_ACQUIRE(parttab[t])->next)
+			part_resize_help(t);
+	part_read_unlock();
+}
+
 // Delete from all tables, return pointer to part or NULL if not present
-struct part *delete_by_name(int name)
+struct part *delete_by_key(int t, int key)
 {
-	int idhash;
-	int namehash = parthash(name);
-	struct part *partp = READ_ONCE(nametab[namehash]);
+	struct part **bkt;
+	struct part **obkt;
+	struct part *partp;
+	int o = !t;
+	int okey;
+	int ret;
 
-	if (!partp)
-		return NULL;
-	acquire_lock(partp);
-	if (READ_ONCE(nametab[namehash]) == partp && partp->name == name) {
-		idhash = parthash(partp->id);
-		if (idtab[idhash] == partp)
-			WRITE_ONCE(idtab[idhash], NULL);
-		WRITE_ONCE(nametab[namehash], NULL);
-		release_lock(partp);
-	} else {
-		release_lock(partp);
-		partp = NULL;
+	// Find the part's key in the other table, then lock both buckets
+	// and the part, rechecking in case anything changed meanwhile.
+	part_read_lock();
+	for (;;) {
+		bkt = part_lock_bucket(t, key);
+		partp = part_find(bkt, t, key);
+		if (!partp) {
+			release_lock(bkt);
+			part_read_unlock();
+			return NULL;
+		}
+		okey = part_key(partp, o);
+		release_lock(bkt);
+		obkt = part_bucket(o, okey);
+		acquire_lock_triple(bkt, obkt, partp);
+		if (*bkt != PART_MOVED && *obkt != PART_MOVED &&
+		    part_find(bkt, t, key) == partp && part_key(partp, o) == okey)
+			break;
+		release_lock_triple(bkt, obkt, partp);
 	}
+	part_write_begin(partp);
+	part_unlink(bkt, t, partp);
+	ret = part_unlink(obkt, o, partp);
+	part_write_end(partp);
+	release_lock_triple(bkt, obkt, partp);
+	part_count_add(t, -1);
+	if (ret)
+		part_count_add(o, -1);
+	part_resize_help(t);
+	part_resize_help(o);
+	part_read_unlock();
 	return partp;
 }
 
-// Insertion helper function
-int insert_part_by_bucket(struct part **bkt, struct part *partp)
+struct part *delete_by_id(int id)
+{
+	return delete_by_key(PT_ID, id);
+}
+
+struct part *delete_by_name(int name)
+{
+	return delete_by_key(PT_NAME, name);
+}
+
+// Insert into the specified table, return true if successful, that is,
+// unless a part with the same key is already present.
+int insert_part(int t, struct part *partp)
 {
+	int key = part_key(partp, t);
+	struct part **bkt;
 	int ret = 0;
 
-	acquire_lock_pair(bkt, partp);
-	if (!*bkt) {
-		WRITE_ONCE(*bkt, partp);
+	part_read_lock();
+	for (;;) {
+		bkt = part_bucket(t, key);
+		acquire_lock_pair(bkt, partp);
+		if (*bkt != PART_MOVED)
+			break;
+		release_lock_pair(bkt, partp);
+	}
+	if (!part_find(bkt, t, key)) {
+		partp->next[t] = *bkt;
+		part_assign_pointer(*bkt, partp);
 		ret = 1;
 	}
 	release_lock_pair(bkt, partp);
+	if (ret)
+		part_count_add(t, 1);
+	part_resize_help(t);
+	part_read_unlock();
 	return ret;
 }
 
 // Insert specified part by its ID, return true if successful
 int insert_part_by_id(struct part *partp)
 {
-	return insert_part_by_bucket(&idtab[parthash(partp->id)], partp);
+	return insert_part(PT_ID, partp);
 }
 
 // Insert specified part by its name, return true if successful
 int insert_part_by_name(struct part *partp)
 {
-	return insert_part_by_bucket(&nametab[parthash(partp->name)], partp);
+	return insert_part(PT_NAME, partp);
 }
 
-// Lookup helper function
-int lookup_by_bucket(struct part **tab, struct part **bkt,
-		     struct part *partp_out)
+#ifdef USE_SEQLOCK
+unsigned long _Atomic seq_retries; // Optimistic lookups that fell back.
+
+// Optimistic lookup helper function, which must be invoked within an
+// EBR read-side critical section.  Returns -1 if the lookup must be
+// retried under the lock.
+int lookup_by_key_seq(int t, int key, struct part *partp_out)
 {
-	int hash = bkt - &tab[0];
-	struct part *partp = READ_ONCE(tab[hash]);
-	int ret = 0;
+	struct part *partp;
+	unsigned int seq;
 
+	partp = part_find_lockless(t, key);
 	if (!partp)
 		return 0;
-	acquire_lock(partp);
-	if (partp == tab[hash]) {
+	seq = READ_ONCE(partp->seq);
+	if (!(seq & 1)) {
+		atomic_thread_fence(memory_order_acquire);
+		*partp_out = *partp;
+		atomic_thread_fence(memory_order_acquire);
+		if (READ_ONCE(partp->seq) == seq)
+			return 1;
+	}
+	atomic_fetch_add_explicit(&seq_retries, 1, memory_order_relaxed);
+	return -1;
+}
+#endif /* #ifdef USE_SEQLOCK */
+
+#ifdef USE_RCU_LOOKUP
+
+// Lookup helper function, lock-free
+int lookup_by_key(int t, int key, struct part *partp_out)
+{
+	struct part *partp;
+	int ret = 0;
+
+	part_read_lock();
+	partp = part_find_lockless(t, key);
+	if (partp) {
 		*partp_out = *partp;
 		ret = 1;
 	}
-	release_lock(partp);
+	part_read_unlock();
 	return ret;
 }
 
-// Lookup part by ID, copying it out and returning true if found
-int lookup_by_id(int id, struct part *partp)
+#else /* #ifdef USE_RCU_LOOKUP */
+
+// Lookup helper function
+int lookup_by_key(int t, int key, struct part *partp_out)
 {
-	int ret = lookup_by_bucket(idtab, &idtab[parthash(id)], partp);
+	struct part **bkt;
+	struct part *partp;
+	int ret = 0;
 
-	if (partp->id == id)
+	part_read_lock();
+#ifdef USE_SEQLOCK
+	ret = lookup_by_key_seq(t, key, partp_out);
+	if (ret >= 0) {
+		part_read_unlock();
 		return ret;
-	return 0;
+	}
+	ret = 0;
+#endif /* #ifdef USE_SEQLOCK */
+	bkt = part_lock_bucket(t, key);
+	partp = part_find(bkt, t, key);
+	if (partp) {
+		*partp_out = *partp;
+		ret = 1;
+	}
+	release_lock(bkt);
+	part_read_unlock();
+	return ret;
+}
+
+#endif /* #else #ifdef USE_RCU_LOOKUP */
+
+// Lookup part by ID, copying it out and returning true if found
+int lookup_by_id(int id, struct part *partp)
+{
+	return lookup_by_key(PT_ID, id, partp);
 }
 
 // Lookup part by name, copying it out and returning true if found
 int lookup_by_name(int name, struct part *partp)
 {
-	int ret = lookup_by_bucket(nametab, &nametab[parthash(name)], partp);
-
-	if (partp->name == name)
-		return ret;
-	return 0;
+	return lookup_by_key(PT_NAME, name, partp);
 }
 
-int alloc_and_insert_part_by_id(struct part *p)
+// Insert p's malloc()ed shadow into table t, return true if successful.
+// If the shadow is already in the other table, it is reused as is, since
+// overwriting it would corrupt that table's hash chain.
+int alloc_and_insert_part(int t, struct part *p)
 {
 	struct part *q = p->statp;
 	int ret;
 
-	if (!q)
-		q = malloc(sizeof(*q));
+	if (q)
+		return insert_part(t, q);
+	q = malloc(sizeof(*q));
 	assert(q);
 	*q = *p;
 	p->statp = q;
 	q->statp = p;
-	ret = insert_part_by_id(q);
+	ret = insert_part(t, q);
 	if (!ret) {
 		p->statp = NULL;
 		free(q);
@@ -165,23 +603,14 @@ int alloc_and_insert_part_by_id(struct part *p)
 	return ret;
 }
 
-int alloc_and_insert_part_by_name(struct part *p)
+int alloc_and_insert_part_by_id(struct part *p)
 {
-	struct part *q = p->statp;
-	int ret;
+	return alloc_and_insert_part(PT_ID, p);
+}
 
-	if (!q)
-		q = malloc(sizeof(*q));
-	assert(q);
-	*q = *p;
-	p->statp = q;
-	q->statp = p;
-	ret = insert_part_by_name(q);
-	if (!ret) {
-		p->statp = NULL;
-		free(q);
-	}
-	return ret;
+int alloc_and_insert_part_by_name(struct part *p)
+{
+	return alloc_and_insert_part(PT_NAME, p);
 }
 
 struct part *delete_and_free_by_id(int id)
@@ -192,7 +621,7 @@ struct part *delete_and_free_by_id(int id)
 	if (!q)
 		return NULL;
 	p = q->statp;
-	free(q);
+	part_free(q);
 	p->statp = NULL;
 	return p;
 }
@@ -206,24 +635,56 @@ struct part *delete_and_free_by_name(int name)
 		return NULL;
 	p = q->statp;
 
-	free(q);
+	part_free(q);
 	p->statp = NULL;
 	return p;
 }
 
 int nthreads = 4;
 int partsperthread = 1000;
+int readsecs; // Seconds per reader count for readtest(), or 0 to skip it.
+struct part *readparts; // The parts that readtest() looks up.
+int loadsecs; // Seconds per load factor for loadtest(), or 0 to skip it.
+struct part *loadparts; // The parts that loadtest() inserts and looks up.
+long nloadparts;
 int _Atomic goflag;
+int perfctrs; // Measure hardware performance counters?
+struct perfctr_totals stress_perf;
+int results_fmt = RESULTS_NONE;
+int affinity = AFFINITY_NONE;
+char *progname;
+struct part *partbin;
 
 void *stress_shard(void *arg)
 {
 	uintptr_t count = 0;
 	int i;
 	struct part *partbase = (struct part *)arg;
+	struct perfctr pc;
 
 	printf("%s: partbase: %p\n", __func__, partbase);
+	affinity_pin(0, (partbase - partbin) / partsperthread);
+
+	// Initialize our own parts, so that they are NUMA-local if pinned.
+	for (i = 0; i < partsperthread; i++) {
+		struct part *p = &partbase[i];
+		int j = p - partbin;
+
+		p->name = j;
+		p->id = 3 * j;
+		p->data = 7 * j;
+		p->namestate = 0;
+		p->idstate = 0;
+		p->statp = NULL;
+		p->seq = 0;
+		p->next[PT_ID] = NULL;
+		p->next[PT_NAME] = NULL;
+	}
+	part_register_thread();
 	while (!atomic_load(&goflag))
 		continue;
+	if (perfctrs)
+		perfctr_start(&pc);
 	while (atomic_load(&goflag) < 2) {
 		for (i = 0; i < partsperthread; i++) {
 			struct part *p = &partbase[i];
@@ -285,27 +746,91 @@ void *stress_shard(void *arg)
 		}
 		count++;
 	}
+	if (perfctrs)
+		perfctr_stop(&pc, &stress_perf);
+	part_unregister_thread();
 	return (void *)count;
 }
 
+// Print the occupancy of n slots, given the number of items in each.
+// The dispersion index is the variance divided by the mean, which is
+// about 1 for random placement, 0 for perfectly even placement, and
+// much larger than 1 for clustered placement.
+void occupancy_print(const char *what, long *counts, long n)
+{
+	double mean;
+	double var = 0;
+	long nempty = 0;
+	long total = 0;
+	long max = 0;
+	long i;
+
+	for (i = 0; i < n; i++) {
+		total += counts[i];
+		if (!counts[i])
+			nempty++;
+		if (counts[i] > max)
+			max = counts[i];
+	}
+	mean = (double)total / n;
+	for (i = 0; i < n; i++)
+		var += (counts[i] - mean) * (counts[i] - mean);
+	var /= n;
+	printf("%s occupancy: %ld slots, %ld items, %.1f%% empty, max %ld, max/mean %.2f, dispersion %.2f\n",
+	       what, n, total, 100. * nempty / n, max,
+	       total ? max / mean : 0., total ? var / mean : 0.);
+}
+
+// Report how evenly the current hash policy would spread the specified
+// parts over the buckets of the tables at their current sizes, and how
+// evenly the parts' addresses spread over the lock shards, regardless
+// of which parts happen to be in the tables.
+void distribution_report(struct part *parts, long nparts)
+{
+	static const char *what[] = { "ID bucket", "name bucket" };
+	long *counts;
+	long n;
+	long i;
+	int t;
+
+	part_resize_finish();
+	printf("Hash policy %s:\n", hash_policy_names[hash_policy]);
+	for (t = 0; t < 2; t++) {
+		n = parttab[t]->n;
+		counts = calloc(n, sizeof(*counts));
+		if (!counts) {
+			perror("calloc");
+			exit(1);
+		}
+		for (i = 0; i < nparts; i++)
+			counts[parthash(part_key(&parts[i], t), n)]++;
+		occupancy_print(what[t], counts, n);
+		free(counts);
+	}
+	counts = calloc(N_LOCK_SHARDS, sizeof(*counts));
+	if (!counts) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i < nparts; i++)
+		counts[hash_lock(&parts[i])]++;
+	occupancy_print("Part lock shard", counts, N_LOCK_SHARDS);
+	free(counts);
+}
+
 void stresstest(void)
 {
 	int i;
-	struct part *partbin;
 	pthread_t *tidp;
 	void *vp;
+	uintptr_t nloops = 0;
+	struct results res;
+	char params[96];
 
 	printf("Starting stress test.\n");
+	perfctr_init(&stress_perf);
 	partbin = malloc(sizeof(*partbin) * nthreads * partsperthread);
 	tidp = malloc(sizeof(*tidp) * nthreads);
-	for (i = 0; i < nthreads * partsperthread; i++) {
-		partbin[i].name = i;
-		partbin[i].id = 3 * i;
-		partbin[i].data = 7 * i;
-		partbin[i].namestate = 0;
-		partbin[i].idstate = 0;
-		partbin[i].statp = NULL;
-	}
 	for (i = 0; i < nthreads; i++) {
 		if (pthread_create(&tidp[i], NULL, stress_shard,
 				   (void *)&partbin[i * partsperthread])) {
@@ -313,6 +838,7 @@ void stresstest(void)
 			exit(1);
 		}
 	}
+	results_start(&res);
 	atomic_store(&goflag, 1);
 	poll(NULL, 0, 10000);
 	atomic_store(&goflag, 2);
@@ -322,22 +848,501 @@ void stresstest(void)
 			exit(1);
 		}
 		printf("Thread %d # loops: %lu\n", i, (uintptr_t)vp);
+		nloops += (uintptr_t)vp;
 	}
+	results_stop(&res);
+	snprintf(params, sizeof(params), "parts=%d;nhash=%ld;nlock=%d;a=%s;h=%s",
+		 partsperthread, parttab[PT_ID]->n, N_LOCK_SHARDS,
+		 affinity_names[affinity], hash_policy_names[hash_policy]);
+	results_print(results_fmt, progname, params, nthreads,
+		      (double)nloops * partsperthread, &res);
+	if (perfctrs)
+		perfctr_print(&stress_perf, "stresstest", "part-visit",
+			      (double)nloops * partsperthread);
+#ifdef USE_SEQLOCK
+	printf("Optimistic lookups retried under lock: %lu\n",
+	       atomic_load(&seq_retries));
+#endif
+	distribution_report(partbin, nthreads * partsperthread);
 	for (i = 0; i < nthreads * partsperthread; i++)
 		free(partbin[i].statp);
 	free(partbin);
 	free(tidp);
 }
 
+// Look up each of readparts[] by ID and by name, starting at an offset
+// that differs for each thread.
+void *read_shard(void *arg)
+{
+	uintptr_t count = 0;
+	long me = (long)arg;
+	struct part part_out;
+	int i;
+
+	affinity_pin(0, me);
+	part_register_thread();
+	while (!atomic_load(&goflag))
+		continue;
+	while (atomic_load(&goflag) < 2) {
+		for (i = 0; i < N_HASH; i++) {
+			struct part *p = &readparts[(i + me * 17) % N_HASH];
+
+			assert(lookup_by_id(p->id, &part_out));
+			assert(part_out.data == p->data);
+			assert(lookup_by_name(p->name, &part_out));
+			assert(part_out.data == p->data);
+		}
+		count += 2 * N_HASH;
+	}
+	part_unregister_thread();
+	return (void *)count;
+}
+
+// Read-only test, reporting lookup throughput for 1, 2, 4, ... readers,
+// up to nthreads.
+void readtest(void)
+{
+	int i;
+	int n;
+	pthread_t *tidp;
+	void *vp;
+	uintptr_t nlookups;
+	struct results res;
+	char params[96];
+
+	printf("Starting read test.\n");
+	readparts = malloc(sizeof(*readparts) * N_HASH);
+	tidp = malloc(sizeof(*tidp) * nthreads);
+	if (!readparts || !tidp) {
+		perror("malloc");
+		exit(1);
+	}
+	for (i = 0; i < N_HASH; i++) {
+		struct part *p = &readparts[i];
+
+		p->name = i;
+		p->id = 3 * i;
+		p->data = 7 * i;
+		p->namestate = 1;
+		p->idstate = 1;
+		p->statp = NULL;
+		p->seq = 0;
+		assert(insert_part_by_id(p));
+		assert(insert_part_by_name(p));
+	}
+	for (n = 1; ; n = 2 * n < nthreads ? 2 * n : nthreads) {
+		atomic_store(&goflag, 0);
+		for (i = 0; i < n; i++) {
+			if (pthread_create(&tidp[i], NULL, read_shard, (void *)(long)i)) {
+				perror("pthread_create");
+				exit(1);
+			}
+		}
+		results_start(&res);
+		atomic_store(&goflag, 1);
+		poll(NULL, 0, readsecs * 1000);
+		atomic_store(&goflag, 2);
+		nlookups = 0;
+		for (i = 0; i < n; i++) {
+			if (pthread_join(tidp[i], &vp)) {
+				perror("pthread_join");
+				exit(1);
+			}
+			nlookups += (uintptr_t)vp;
+		}
+		results_stop(&res);
+		printf("%d readers: %.0f lookups/sec\n", n, nlookups / res.wall);
+		snprintf(params, sizeof(params), "mode=read;nhash=%ld;nlock=%d;a=%s;h=%s",
+			 parttab[PT_ID]->n, N_LOCK_SHARDS, affinity_names[affinity],
+			 hash_policy_names[hash_policy]);
+		results_print(results_fmt, progname, params, n, nlookups, &res);
+		if (n == nthreads)
+			break;
+	}
+	for (i = 0; i < N_HASH; i++)
+		assert(delete_by_id(readparts[i].id) == &readparts[i]);
+	atomic_store(&goflag, 0);
+	free(readparts);
+	free(tidp);
+}
+
+// Insert every nthreads-th part of loadparts[] by ID and by name.
+void *load_insert_shard(void *arg)
+{
+	uintptr_t count = 0;
+	long me = (long)arg;
+	long i;
+
+	affinity_pin(0, me);
+	part_register_thread();
+	while (!atomic_load(&goflag))
+		continue;
+	for (i = me; i < nloadparts; i += nthreads) {
+		assert(insert_part_by_id(&loadparts[i]));
+		assert(insert_part_by_name(&loadparts[i]));
+		count += 2;
+	}
+	part_unregister_thread();
+	return (void *)count;
+}
+
+// Repeatedly delete every nthreads-th part of loadparts[] and reinsert
+// it by ID and by name, which keeps the load factor steady.
+void *load_update_shard(void *arg)
+{
+	uintptr_t count = 0;
+	long me = (long)arg;
+	long i;
+
+	affinity_pin(0, me);
+	part_register_thread();
+	while (!atomic_load(&goflag))
+		continue;
+	while (atomic_load(&goflag) < 2) {
+		for (i = me; i < nloadparts; i += nthreads) {
+			struct part *p = &loadparts[i];
+
+			assert(delete_by_id(p->id) == p);
+			assert(insert_part_by_id(p));
+			assert(insert_part_by_name(p));
+			count++;
+		}
+	}
+	part_unregister_thread();
+	return (void *)count;
+}
+
+// Look up every nthreads-th part of loadparts[] by ID and by name.
+void *load_lookup_shard(void *arg)
+{
+	uintptr_t count = 0;
+	long me = (long)arg;
+	struct part part_out;
+	long i;
+
+	affinity_pin(0, me);
+	part_register_thread();
+	while (!atomic_load(&goflag))
+		continue;
+	while (atomic_load(&goflag) < 2) {
+		for (i = me; i < nloadparts; i += nthreads) {
+			struct part *p = &loadparts[i];
+
+			assert(lookup_by_id(p->id, &part_out));
+			assert(part_out.data == p->data);
+			assert(lookup_by_name(p->name, &part_out));
+			assert(part_out.data == p->data);
+			count += 2;
+		}
+	}
+	part_unregister_thread();
+	return (void *)count;
+}
+
+// Run nthreads instances of func, either to completion if secs is zero
+// or for secs seconds otherwise, returning the sum of their counts.
+uintptr_t load_phase(void *(*func)(void *), int secs, struct results *res)
+{
+	pthread_t *tidp;
+	uintptr_t count = 0;
+	void *vp;
+	long i;
+
+	tidp = malloc(sizeof(*tidp) * nthreads);
+	if (!tidp) {
+		perror("malloc");
+		exit(1);
+	}
+	atomic_store(&goflag, 0);
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&tidp[i], NULL, func, (void *)i)) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	results_start(res);
+	atomic_store(&goflag, 1);
+	if (secs) {
+		poll(NULL, 0, secs * 1000);
+		atomic_store(&goflag, 2);
+	}
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_join(tidp[i], &vp)) {
+			perror("pthread_join");
+			exit(1);
+		}
+		count += (uintptr_t)vp;
+	}
+	results_stop(res);
+	atomic_store(&goflag, 0);
+	free(tidp);
+	return count;
+}
+
+// Report update and lookup throughput for load factors (parts per hash
+// bucket) of 1/4, 1/2, 1, ... 8, running each for loadsecs seconds.  An
+// update deletes a part and reinserts it by ID and by name.
+void loadtest(void)
+{
+	struct results res;
+	char params[96];
+	long nhash = parttab[PT_ID]->n;
+	uintptr_t n;
+	double lf;
+	int maxchain;
+	int len;
+	long i;
+	int q;
+
+	printf("Starting load-factor test.\n");
+	loadparts = malloc(sizeof(*loadparts) * 8 * nhash);
+	if (!loadparts) {
+		perror("malloc");
+		exit(1);
+	}
+	for (q = 1; q <= 32; q *= 2) {
+		lf = q / 4.0;
+		nloadparts = q * nhash / 4;
+		for (i = 0; i < nloadparts; i++) {
+			struct part *p = &loadparts[i];
+
+			p->name = i;
+			p->id = 3 * i;
+			p->data = 7 * i;
+			p->namestate = 1;
+			p->idstate = 1;
+			p->statp = NULL;
+			p->seq = 0;
+		}
+
+		load_phase(load_insert_shard, 0, &res);
+		n = load_phase(load_update_shard, loadsecs, &res);
+		printf("load factor %.2f: %.0f updates/sec\n", lf, n / res.wall);
+		snprintf(params, sizeof(params),
+			 "mode=update;lf=%.2f;nhash=%ld;nlock=%d;a=%s;h=%s",
+			 lf, nhash, N_LOCK_SHARDS, affinity_names[affinity],
+			 hash_policy_names[hash_policy]);
+		results_print(results_fmt, progname, params, nthreads, n, &res);
+
+		n = load_phase(load_lookup_shard, loadsecs, &res);
+		maxchain = 0;
+		for (i = 0; i < nhash; i++) {
+			struct part *p;
+
+			len = 0;
+			for (p = parttab[PT_ID]->bkt[i]; p; p = p->next[PT_ID])
+				len++;
+			if (len > maxchain)
+				maxchain = len;
+		}
+		printf("load factor %.2f: %.0f lookups/sec, longest chain %d\n",
+		       lf, n / res.wall, maxchain);
+		snprintf(params, sizeof(params),
+			 "mode=lookup;lf=%.2f;nhash=%ld;nlock=%d;a=%s;h=%s",
+			 lf, nhash, N_LOCK_SHARDS, affinity_names[affinity],
+			 hash_policy_names[hash_policy]);
+		results_print(results_fmt, progname, params, nthreads, n, &res);
+
+		for (i = 0; i < nloadparts; i++)
+			assert(delete_by_id(loadparts[i].id) == &loadparts[i]);
+	}
+	free(loadparts);
+}
+
+int resizetest_maxload; // Load factor for resizetest(), or 0 to skip it.
+struct part *resizeparts; // The parts that resizetest() inserts.
+long nresizeparts;
+struct hist resize_hist[3][2]; // By operation, then by resize in progress.
+const char *resize_ops[] = { "insert", "lookup", "delete" };
+
+// Is either table being resized?
+int part_resizing(void)
+{
+	int ret;
+
+	part_read_lock();
+	ret = LOAD_ACQUIRE(parttab[PT_ID])->next ||
+	      LOAD_ACQUIRE(parttab[PT_NAME])->next;
+	part_read_unlock();
+	return ret;
+}
+
+// Insert every nthreads-th pair of parts of resizeparts[] by ID and by
+// name, then delete the first of the pair, so that deletes race with the
+// resizes that the inserts trigger, and look up a random one of the
+// parts still inserted.  Then delete the rest, recording the latency of
+// each operation.
+void *resize_shard(void *arg)
+{
+	struct hist h[3][2];
+	unsigned long x = (long)arg * 2 + 1;
+	long me = (long)arg;
+	struct part part_out;
+	unsigned long t0;
+	long i;
+	long j;
+	long n = 0;
+	int k;
+	int r;
+
+	affinity_pin(0, me);
+	part_register_thread();
+	for (i = 0; i < 3; i++) {
+		hist_init(&h[i][0]);
+		hist_init(&h[i][1]);
+	}
+	while (!atomic_load(&goflag))
+		continue;
+	for (i = 2 * me; i + 1 < nresizeparts; i += 2 * nthreads) {
+		for (k = 0; k < 2; k++) {
+			struct part *p = &resizeparts[i + k];
+
+			r = part_resizing();
+			t0 = nsec_now();
+			assert(insert_part_by_id(p));
+			assert(insert_part_by_name(p));
+			hist_record(&h[0][r], (nsec_now() - t0) / 2);
+		}
+		r = part_resizing();
+		t0 = nsec_now();
+		assert(delete_by_id(resizeparts[i].id) == &resizeparts[i]);
+		hist_record(&h[2][r], nsec_now() - t0);
+		n++;
+
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		j = 2 * (me + (x % n) * nthreads) + 1;
+		r = part_resizing();
+		t0 = nsec_now();
+		assert(lookup_by_id(resizeparts[j].id, &part_out));
+		hist_record(&h[1][r], nsec_now() - t0);
+		assert(part_out.data == resizeparts[j].data);
+	}
+	for (i = 2 * me + 1; i < nresizeparts; i += 2 * nthreads) {
+		r = part_resizing();
+		t0 = nsec_now();
+		assert(delete_by_id(resizeparts[i].id) == &resizeparts[i]);
+		hist_record(&h[2][r], nsec_now() - t0);
+	}
+	for (i = 0; i < 3; i++) {
+		hist_merge(&resize_hist[i][0], &h[i][0]);
+		hist_merge(&resize_hist[i][1], &h[i][1]);
+	}
+	part_unregister_thread();
+	return NULL;
+}
+
+// Insert 128 parts per initial bucket into the tables while deleting
+// every other one and looking up the rest, letting the tables grow
+// whenever they average more than resizetest_maxload parts per bucket,
+// then delete them all.  Reports the latency of each kind of operation
+// separately for those that started while a resize was and was not in
+// progress.  The tables never shrink, so they are then replaced by empty
+// ones of the original size for the tests that follow.
+void resizetest(void)
+{
+	pthread_t *tidp;
+	struct results res;
+	char params[96];
+	char what[64];
+	long nhash[2];
+	unsigned long nr;
+	long i;
+	int j;
+
+	printf("Starting resize test.\n");
+	nhash[PT_ID] = parttab[PT_ID]->n;
+	nhash[PT_NAME] = parttab[PT_NAME]->n;
+	nr = atomic_load(&n_resizes);
+	nresizeparts = 128 * nhash[PT_ID];
+	resizeparts = malloc(sizeof(*resizeparts) * nresizeparts);
+	tidp = malloc(sizeof(*tidp) * nthreads);
+	if (!resizeparts || !tidp) {
+		perror("malloc");
+		exit(1);
+	}
+	for (i = 0; i < nresizeparts; i++) {
+		struct part *p = &resizeparts[i];
+
+		p->name = i;
+		p->id = 3 * i;
+		p->data = 7 * i;
+		p->namestate = 1;
+		p->idstate = 1;
+		p->statp = NULL;
+		p->seq = 0;
+	}
+	for (i = 0; i < 3; i++) {
+		hist_init(&resize_hist[i][0]);
+		hist_init(&resize_hist[i][1]);
+	}
+	resize_maxload = resizetest_maxload;
+	atomic_store(&goflag, 0);
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&tidp[i], NULL, resize_shard, (void *)i)) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	results_start(&res);
+	atomic_store(&goflag, 1);
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_join(tidp[i], NULL)) {
+			perror("pthread_join");
+			exit(1);
+		}
+	}
+	results_stop(&res);
+	atomic_store(&goflag, 0);
+	resize_maxload = 0;
+	part_resize_finish();
+	printf("Resized %lu times: ID table %ld -> %ld buckets, name table %ld -> %ld buckets\n",
+	       atomic_load(&n_resizes) - nr, nhash[PT_ID], parttab[PT_ID]->n,
+	       nhash[PT_NAME], parttab[PT_NAME]->n);
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 2; j++) {
+			snprintf(what, sizeof(what), "%s (%s)", resize_ops[i],
+				 j ? "resizing" : "steady");
+			hist_print(&resize_hist[i][j], progname, what);
+		}
+	}
+	snprintf(params, sizeof(params),
+		 "mode=resize;maxload=%d;nhash=%ld;nlock=%d;a=%s;h=%s",
+		 resizetest_maxload, nhash[PT_ID], N_LOCK_SHARDS,
+		 affinity_names[affinity], hash_policy_names[hash_policy]);
+	results_print(results_fmt, progname, params, nthreads,
+		      2.5 * nresizeparts, &res);
+	part_tables_free();
+	part_tables_init();
+	free(resizeparts);
+	free(tidp);
+}
+
+// Return the smallest key above key that hashes to the same bucket of
+// table t, under the current hash policy and table size.
+int part_colliding_key(int t, int key)
+{
+	long n = parttab[t]->n;
+	int k;
+
+	for (k = key + 1; parthash(k, n) != parthash(key, n); k++)
+		continue;
+	return k;
+}
+
 void smoketest(void)
 {
 	struct part p0 = { .name = 5, .id = 10, .data = 42, };
 	struct part p1 = { .name = 5, .id = 11, .data = 43, };
 	struct part p2 = { .name = 6, .id = 10, .data = 44, };
 	struct part p3 = { .name = 7, .id = 12, .data = 45, };
+	struct part p4 = { .data = 46, };
 	struct part pout;
 
 	printf("Starting smoke test.\n");
+	p4.name = part_colliding_key(PT_NAME, 7);
+	p4.id = part_colliding_key(PT_ID, 12);
 	assert(insert_part_by_id(&p0));
 	assert(insert_part_by_name(&p0));
 	assert(!insert_part_by_name(&p1));
@@ -348,12 +1353,23 @@ void smoketest(void)
 
 	assert(lookup_by_name(7, &pout));
 	assert(pout.name == 7 && pout.id == 12);
-	assert(!lookup_by_name(7 + N_HASH, &pout));
+	assert(!lookup_by_name(p4.name, &pout));
 	assert(!lookup_by_name(6, &pout));
 	assert(lookup_by_id(10, &pout));
 	assert(pout.name == 5 && pout.id == 10);
 	assert(!lookup_by_id(11, &pout));
 
+	// p4 collides with p3 in both tables.
+	assert(insert_part_by_id(&p4));
+	assert(insert_part_by_name(&p4));
+	assert(lookup_by_name(p4.name, &pout));
+	assert(pout.data == 46);
+	assert(lookup_by_id(12, &pout));
+	assert(pout.data == 45);
+	assert(delete_by_name(p4.name) == &p4);
+	assert(lookup_by_name(7, &pout));
+	assert(!lookup_by_id(p4.id, &pout));
+
 	assert(delete_by_id(10) == &p0);
 	assert(!delete_by_id(11));
 	assert(delete_by_name(7) == &p3);
@@ -370,7 +1386,7 @@ void smoketest(void)
 
 	assert(lookup_by_name(7, &pout));
 	assert(pout.name == 7 && pout.id == 12);
-	assert(!lookup_by_name(7 + N_HASH, &pout));
+	assert(!lookup_by_name(p4.name, &pout));
 	assert(!lookup_by_name(6, &pout));
 	assert(lookup_by_id(10, &pout));
 	assert(pout.name == 5 && pout.id == 10);
@@ -382,9 +1398,82 @@ void smoketest(void)
 	assert(!delete_and_free_by_name(6));
 }
 
+void usage(char *progname)
+{
+	fprintf(stderr, "Usage: %s [options]\n", progname);
+	fprintf(stderr, "\t-a: Thread placement: none, compact, scatter, cross-socket or smt-pair.\n");
+	fprintf(stderr, "\t-H: Hash policy: modulo, fibonacci, murmur (default) or wyhash.\n");
+	fprintf(stderr, "\t-l: Run a load-factor test for the specified number of seconds per load factor and operation.\n");
+	fprintf(stderr, "\t-o: Print a machine-readable result in the specified format (csv or json).\n");
+	fprintf(stderr, "\t-P: Print hardware performance counter metrics.\n");
+	fprintf(stderr, "\t-R: Run a resize test, growing the tables past the specified parts per bucket.\n");
+	fprintf(stderr, "\t-r: Run a read-only test for the specified number of seconds per reader count.\n");
+	fprintf(stderr, "\t-t: Number of threads, default %d.\n", nthreads);
+	exit(1);
+}
+
 int main(int argc, char *argv[])
 {
+	int c;
+
+	progname = argv[0];
+	while ((c = getopt(argc, argv, "a:H:l:o:PR:r:t:")) != -1) {
+		switch (c) {
+		case 'a':
+			affinity = affinity_parse(optarg);
+			if (affinity < 0)
+				usage(argv[0]);
+			break;
+		case 'H':
+			if (hash_policy_set(optarg) < 0)
+				usage(argv[0]);
+			break;
+		case 'l':
+			loadsecs = strtol(optarg, NULL, 0);
+			if (loadsecs < 1)
+				usage(argv[0]);
+			break;
+		case 'o':
+			results_fmt = results_format(optarg);
+			if (results_fmt < 0)
+				usage(argv[0]);
+			break;
+		case 'P':
+			perfctrs = 1;
+			break;
+		case 'R':
+			resizetest_maxload = strtol(optarg, NULL, 0);
+			if (resizetest_maxload < 1)
+				usage(argv[0]);
+			break;
+		case 'r':
+			readsecs = strtol(optarg, NULL, 0);
+			if (readsecs < 1)
+				usage(argv[0]);
+			break;
+		case 't':
+			nthreads = strtol(optarg, NULL, 0);
+			if (nthreads < 1)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc)
+		usage(argv[0]);
+	affinity_init(affinity, nthreads);
+	if (affinity != AFFINITY_NONE)
+		affinity_print(progname);
+	part_tables_init();
 	smoketest();
+	if (readsecs)
+		readtest();
+	if (loadsecs)
+		loadtest();
+	if (resizetest_maxload)
+		resizetest();
 	stresstest();
+	part_tables_free();
 	return 0;
 }